@@ -0,0 +1,173 @@
+//
+//  Batch.cpp
+//  local-hough-line-cpp
+//
+//  Created by 박성현 on 17/10/2026.
+//  Copyright © 2019 Sean Park. All rights reserved.
+//
+
+#include "Batch.hpp"
+#include "Helper.hpp"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/core/utils/filesystem.hpp>
+
+namespace fh {
+    
+    // File name without its directory and extension
+    static std::string imageName(const std::string& path) {
+        size_t slash = path.find_last_of("/\\");
+        std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+        size_t dot = name.find_last_of('.');
+        return dot == std::string::npos ? name : name.substr(0, dot);
+    }
+    
+    // An input path and its position in the input, which keeps output names unique
+    struct BatchInput {
+        int index = 0;
+        std::string path;
+    };
+    
+    // Hands every input path to the queue. Paths of a list are read one by one,
+    // so a list of millions of frames is never held in memory at once.
+    // Returns false if the input is neither a directory nor a readable list.
+    static bool readInputs(const std::string& input, BlockingQueue<BatchInput>& queue) {
+        bool isRead = true;
+        int index = 0;
+        if (cv::utils::fs::isDirectory(input)) {
+            std::string dir = input.back() == '/' ? input : input + "/";
+            std::vector<cv::String> paths;
+            for (auto pattern: {"*.jpg", "*.png"}) {
+                std::vector<cv::String> found;
+                cv::glob(dir + pattern, found, false);
+                paths.insert(paths.end(), found.begin(), found.end());
+            }
+            for (auto& path: paths) {
+                if (!queue.push({index++, path})) {
+                    break;
+                }
+            }
+        } else {
+            std::ifstream list(input);
+            if (!list) {
+                std::cout << "[Batch] Failed to open input: " << input << std::endl;
+                isRead = false;
+            }
+            std::string path;
+            while (std::getline(list, path)) {
+                if (!path.empty() && !queue.push({index++, path})) {
+                    break;
+                }
+            }
+        }
+        queue.close();
+        return isRead;
+    }
+    
+    static bool writeLines(const std::string& path, const std::vector<Line>& lines) {
+        std::ofstream file(path);
+        if (!file) {
+            return false;
+        }
+        // rho theta votes, one line per row
+        for (auto& line: lines) {
+            file << line[0] << " " << line[1] << " " << line[2] << "\n";
+        }
+        return bool(file);
+    }
+    
+    BatchSummary runBatch(const BatchParams& params) {
+        int threads = params.threads > 0 ? params.threads : MAX(1, (int)std::thread::hardware_concurrency());
+        int queueLength = params.queueLength > 0 ? params.queueLength : threads * 4;
+        
+        // Images are spread over workers, so each detection runs on a single thread
+        LineParams lineParams = params.lineParams;
+        lineParams.threads = 1;
+        
+        if (!params.outputDir.empty()) {
+            cv::utils::fs::createDirectories(params.outputDir);
+        }
+        
+        BlockingQueue<BatchInput> queue(queueLength);
+        std::mutex mutex;
+        std::vector<double> latencies;
+        BatchSummary summary;
+        
+        auto start = std::chrono::steady_clock::now();
+        bool isInputRead = false;
+        std::thread reader([&]() {
+            try {
+                isInputRead = readInputs(params.input, queue);
+            } catch (const std::exception& e) {
+                // Workers wait for the queue to close
+                queue.close();
+                std::lock_guard<std::mutex> lock(mutex);
+                std::cout << "[Batch] Failed to read input: " << e.what() << std::endl;
+            }
+        });
+        
+        parallelFor(threads, threads, [&](int) {
+            LineFinder finder(lineParams);
+            std::vector<Line> lines;
+            std::vector<double> localLatencies;
+            int localFailures = 0;
+            int localLines = 0;
+            
+            BatchInput input;
+            while (queue.pop(input)) {
+                const std::string& path = input.path;
+                // An exception would end the worker and the program, so it fails this image only
+                try {
+                    auto begin = std::chrono::steady_clock::now();
+                    cv::Mat image = cv::imread(path, cv::IMREAD_COLOR);
+                    if (image.empty()) {
+                        ++localFailures;
+                        continue;
+                    }
+                    
+                    finder.process(image);
+                    finder.detect(params.mode, lines);
+                    
+                    if (!params.outputDir.empty()) {
+                        // Inputs of different directories may share a name, so the name starts with the position
+                        std::string output = params.outputDir + "/" + std::to_string(input.index) + "_" + imageName(path) + ".txt";
+                        if (!writeLines(output, lines)) {
+                            ++localFailures;
+                            continue;
+                        }
+                    }
+                    auto end = std::chrono::steady_clock::now();
+                    localLatencies.push_back(std::chrono::duration<double, std::milli>(end - begin).count());
+                    localLines += lines.size();
+                } catch (const std::exception& e) {
+                    ++localFailures;
+                    std::lock_guard<std::mutex> lock(mutex);
+                    std::cout << "[Batch] Failed on " << path << ": " << e.what() << std::endl;
+                }
+            }
+            
+            std::lock_guard<std::mutex> lock(mutex);
+            latencies.insert(latencies.end(), localLatencies.begin(), localLatencies.end());
+            summary.failures += localFailures;
+            summary.lines += localLines;
+        });
+        
+        reader.join();
+        auto end = std::chrono::steady_clock::now();
+        if (!isInputRead) {
+            ++summary.failures;
+        }
+        
+        std::sort(latencies.begin(), latencies.end());
+        summary.images = (int)latencies.size();
+        summary.seconds = std::chrono::duration<double>(end - start).count();
+        summary.p50Ms = percentile(latencies, 0.50);
+        summary.p99Ms = percentile(latencies, 0.99);
+        return summary;
+    }
+}
@@ -0,0 +1,55 @@
+//
+//  Batch.hpp
+//  local-hough-line-cpp
+//
+//  Created by 박성현 on 17/10/2026.
+//  Copyright © 2019 Sean Park. All rights reserved.
+//
+
+#ifndef Batch_hpp
+#define Batch_hpp
+
+#include <string>
+#include <vector>
+#include "LineFinder.hpp"
+
+namespace fh {
+    
+    class BatchParams {
+    public:
+        // A directory, which is globbed for *.jpg and *.png, or a text file with one path per line
+        std::string input;
+        // Lines of each image are written to <outputDir>/<index>_<image name>.txt, where index is
+        // the position of the image in the input. Empty writes nothing.
+        std::string outputDir;
+        HoughMode mode = HoughMode::StandardLocal;
+        // Worker threads. 0 uses every core.
+        int threads = 0;
+        // Paths waiting for a worker. The reader blocks when this many are pending.
+        int queueLength = 0;
+        
+        LineParams lineParams;
+    };
+    
+    class BatchSummary {
+    public:
+        int images = 0;
+        int failures = 0;
+        int lines = 0;
+        double seconds = 0.0;
+        double p50Ms = 0.0;
+        double p99Ms = 0.0;
+        
+        inline double imagesPerSecond() const {
+            return seconds > 0.0 ? images / seconds : 0.0;
+        }
+    };
+    
+    // Decodes, preprocesses, detects and writes every input on a pool of workers.
+    // Every worker owns one LineFinder, so its buffers are reused from image to image.
+    // An input list which cannot be opened counts as a failure, and so does an image whose
+    // decoding, detection or output throws. The other images go on.
+    BatchSummary runBatch(const BatchParams& params);
+}
+
+#endif /* Batch_hpp */
@@ -0,0 +1,440 @@
+//
+//  Benchmark.cpp
+//  local-hough-line-cpp
+//
+//  Created by 박성현 on 17/10/2026.
+//  Copyright © 2019 Sean Park. All rights reserved.
+//
+
+#include "Benchmark.hpp"
+#include "Helper.hpp"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <vector>
+#include <opencv2/imgcodecs.hpp>
+
+namespace fh {
+    
+    // Stages and modes are reported in this order
+    static const char* const sampleNames[] = {
+        "resize",
+        "smooth",
+        "gray",
+        "canny",
+        "nearEdge",
+        "globalVote",
+        "suppress",
+        "locality",
+        "standardHough",
+        "standardLocalHough",
+        "naiveLocalHough",
+        "fusedLocalHough",
+        "gradientLocalHough",
+        "pyramidLocalHough",
+        "trackedLocalHough",
+    };
+    static const int sampleCount = sizeof(sampleNames) / sizeof(sampleNames[0]);
+    
+    typedef std::vector<std::vector<double>> Samples; // [sampleCount][runs]
+    
+    // Index of the sample of the given name in sampleNames
+    static int sampleIndex(const std::string& name) {
+        return int(std::find(sampleNames, sampleNames + sampleCount, name) - sampleNames);
+    }
+    
+    // Median of the named sample
+    static double medianOf(const Samples& samples, const std::string& name) {
+        return percentile(samples[sampleIndex(name)], 0.5);
+    }
+    
+    template <typename Work>
+    static double measure(Work work) {
+        auto start = std::chrono::steady_clock::now();
+        work();
+        auto end = std::chrono::steady_clock::now();
+        return std::chrono::duration<double, std::milli>(end - start).count();
+    }
+    
+    // One run of every stage and mode, appended to samples
+    static void runOnce(LineFinder& finder, const cv::Mat& image, std::vector<Line>& candidates, std::vector<Line>& lines, Samples& samples) {
+        finder.process(image);
+        auto& times = finder.preprocessTimes();
+        samples[0].push_back(times.resize);
+        samples[1].push_back(times.smooth);
+        samples[2].push_back(times.gray);
+        samples[3].push_back(times.canny);
+        samples[4].push_back(times.nearEdge);
+        samples[5].push_back(measure([&]() { finder.detectCandidates(candidates); }));
+        samples[6].push_back(measure([&]() { finder.suppressCandidates(candidates); }));
+        samples[7].push_back(measure([&]() { finder.filterByLocality(candidates, lines); }));
+        samples[8].push_back(measure([&]() { finder.detectStandardHough(lines); }));
+        samples[9].push_back(measure([&]() { finder.detectStandardLocalHough(lines); }));
+        samples[10].push_back(measure([&]() { finder.detectNaiveLocalHough(lines); }));
+        samples[11].push_back(measure([&]() { finder.detectFusedLocalHough(lines); }));
+        samples[12].push_back(measure([&]() { finder.detectGradientLocalHough(lines); }));
+        samples[13].push_back(measure([&]() { finder.detectPyramidLocalHough(lines); }));
+        // Every run sees the same frame again, so after the warm-up this is the steady state of tracking
+        samples[14].push_back(measure([&]() { finder.detectTrackedLocalHough(lines); }));
+    }
+    
+    static void writeStats(std::ostream& json, std::vector<double>& runs) {
+        std::sort(runs.begin(), runs.end());
+        json << "{\"min\": " << (runs.empty() ? 0.0 : runs.front())
+             << ", \"median\": " << percentile(runs, 0.50)
+             << ", \"p99\": " << percentile(runs, 0.99) << "}";
+    }
+    
+    static void writeSamples(std::ostream& json, Samples& samples, const char* indent) {
+        json << "{\n";
+        for (int i = 0; i < sampleCount; i++) {
+            json << indent << "    \"" << sampleNames[i] << "\": ";
+            writeStats(json, samples[i]);
+            json << (i < sampleCount - 1 ? ",\n" : "\n");
+        }
+        json << indent << "}";
+    }
+    
+    static std::string escape(const std::string& text) {
+        std::string escaped;
+        for (char c: text) {
+            if (c == '"' || c == '\\') {
+                escaped += '\\';
+            }
+            escaped += c;
+        }
+        return escaped;
+    }
+    
+    bool runBenchmark(const BenchmarkParams& params, std::ostream& json) {
+        std::vector<cv::String> paths;
+        cv::glob(params.imageDir + "*.jpg", paths);
+        
+        json << "{\n";
+        json << "  \"warmup\": " << params.warmup << ",\n";
+        json << "  \"iterations\": " << params.iterations << ",\n";
+        json << "  \"worksheetLength\": " << params.lineParams.worksheetLength << ",\n";
+        json << "  \"houghResolutionTheta\": " << params.lineParams.houghResolutionTheta << ",\n";
+        json << "  \"threads\": " << LineParams(params.lineParams).threadCount() << ",\n";
+        json << "  \"simd\": \"" << simdLevelName(simdLevel()) << "\",\n";
+        json << "  \"images\": [";
+        
+        Samples total(sampleCount);
+        int measured = 0;
+        for (auto& path: paths) {
+            cv::Mat image = cv::imread(path, cv::IMREAD_COLOR);
+            if (image.empty()) {
+                std::cout << "[Benchmark] Failed to open image: " << path << std::endl;
+                continue;
+            }
+            
+            LineFinder finder(params.lineParams);
+            std::vector<Line> candidates;
+            std::vector<Line> lines;
+            Samples samples(sampleCount);
+            for (int i = 0; i < params.warmup; i++) {
+                Samples discarded(sampleCount);
+                runOnce(finder, image, candidates, lines, discarded);
+            }
+            for (int i = 0; i < params.iterations; i++) {
+                runOnce(finder, image, candidates, lines, samples);
+            }
+            for (int i = 0; i < sampleCount; i++) {
+                total[i].insert(total[i].end(), samples[i].begin(), samples[i].end());
+            }
+            
+            json << (measured > 0 ? ",\n" : "\n");
+            json << "    {\n";
+            json << "      \"path\": \"" << escape(path) << "\",\n";
+            json << "      \"width\": " << image.cols << ",\n";
+            json << "      \"height\": " << image.rows << ",\n";
+            json << "      \"samples\": ";
+            writeSamples(json, samples, "      ");
+            json << "\n    }";
+            ++measured;
+            
+            // Samples are sorted by writeSamples() above
+            std::cout << "[Benchmark] " << path << ": preprocess "
+                      << medianOf(samples, "resize") + medianOf(samples, "smooth") + medianOf(samples, "gray")
+                         + medianOf(samples, "canny") + medianOf(samples, "nearEdge")
+                      << "ms, standard local " << medianOf(samples, "standardLocalHough")
+                      << "ms, naive local " << medianOf(samples, "naiveLocalHough")
+                      << "ms, fused local " << medianOf(samples, "fusedLocalHough")
+                      << "ms, gradient local " << medianOf(samples, "gradientLocalHough") << "ms (median)" << std::endl;
+        }
+        
+        json << "\n  ],\n";
+        json << "  \"total\": ";
+        writeSamples(json, total, "  ");
+        json << "\n}\n";
+        
+        return measured > 0;
+    }
+    
+    struct PreprocessOption {
+        const char* name;
+        bool grayFirst;
+        Smoothing smoothing;
+    };
+    
+    // The first option is the default, which the others are compared against
+    static const PreprocessOption preprocessOptions[] = {
+        {"color-bilateral", false, Smoothing::Bilateral},
+        {"color-gaussian", false, Smoothing::Gaussian},
+        {"gray-bilateral", true, Smoothing::Bilateral},
+        {"gray-median", true, Smoothing::Median},
+        {"gray-gaussian", true, Smoothing::Gaussian},
+        {"gray-none", true, Smoothing::None},
+    };
+    static const int preprocessOptionCount = sizeof(preprocessOptions) / sizeof(preprocessOptions[0]);
+    
+    bool runPreprocessBenchmark(const BenchmarkParams& params, std::ostream& json) {
+        std::vector<cv::String> paths;
+        cv::glob(params.imageDir + "*.jpg", paths);
+        
+        // [option] medians of every image, and line counts summed over images
+        std::vector<std::vector<double>> times(preprocessOptionCount);
+        std::vector<int> found(preprocessOptionCount, 0);
+        std::vector<int> precise(preprocessOptionCount, 0);
+        std::vector<int> recalled(preprocessOptionCount, 0);
+        int reference = 0;
+        
+        const LineParams& base = params.lineParams;
+        float rhoTolerance = 2.0f * base.houghResolutionRho;
+        float thetaTolerance = 2.0f * CV_PI / base.houghResolutionTheta;
+        
+        for (auto& path: paths) {
+            cv::Mat image = cv::imread(path, cv::IMREAD_COLOR);
+            if (image.empty()) {
+                std::cout << "[Benchmark] Failed to open image: " << path << std::endl;
+                continue;
+            }
+            
+            std::vector<Line> referenceLines;
+            for (int o = 0; o < preprocessOptionCount; o++) {
+                LineParams lineParams = base;
+                lineParams.grayFirst = preprocessOptions[o].grayFirst;
+                lineParams.smoothing = preprocessOptions[o].smoothing;
+                LineFinder finder(lineParams);
+                
+                std::vector<double> runs;
+                for (int i = 0; i < params.warmup + params.iterations; i++) {
+                    double ms = measure([&]() { finder.process(image); });
+                    if (i >= params.warmup) {
+                        runs.push_back(ms);
+                    }
+                }
+                std::sort(runs.begin(), runs.end());
+                times[o].push_back(percentile(runs, 0.5));
+                
+                std::vector<Line> lines;
+                finder.detectStandardLocalHough(lines);
+                if (o == 0) {
+                    referenceLines = lines;
+                    reference += lines.size();
+                }
+                found[o] += lines.size();
+                precise[o] += countMatchingLines(lines, referenceLines, rhoTolerance, thetaTolerance);
+                recalled[o] += countMatchingLines(referenceLines, lines, rhoTolerance, thetaTolerance);
+            }
+        }
+        if (times[0].empty()) {
+            return false;
+        }
+        
+        json << "{\n";
+        json << "  \"warmup\": " << params.warmup << ",\n";
+        json << "  \"iterations\": " << params.iterations << ",\n";
+        json << "  \"images\": " << times[0].size() << ",\n";
+        json << "  \"referenceLines\": " << reference << ",\n";
+        json << "  \"options\": {";
+        for (int o = 0; o < preprocessOptionCount; o++) {
+            double total = 0.0;
+            for (double ms: times[o]) {
+                total += ms;
+            }
+            // Share of its lines also found by the default, and share of the default's lines it found
+            double precision = found[o] > 0 ? precise[o] / (double)found[o] : 0.0;
+            double recall = reference > 0 ? recalled[o] / (double)reference : 0.0;
+            
+            json << (o > 0 ? ",\n" : "\n");
+            json << "    \"" << preprocessOptions[o].name << "\": {\"preprocessMs\": " << total / times[o].size()
+                 << ", \"lines\": " << found[o]
+                 << ", \"precision\": " << precision
+                 << ", \"recall\": " << recall << "}";
+            
+            std::cout << "[Benchmark] " << preprocessOptions[o].name << ": " << total / times[o].size()
+                      << "ms per image, " << found[o] << " lines, precision " << precision
+                      << ", recall " << recall << std::endl;
+        }
+        json << "\n  }\n}\n";
+        return true;
+    }
+    
+    bool runRunLengthBenchmark(const BenchmarkParams& params, std::ostream& json) {
+        std::vector<cv::String> paths;
+        cv::glob(params.imageDir + "*.jpg", paths);
+        
+        // 0 walks pixel by pixel, and is the reference of the others
+        const LineParams& base = params.lineParams;
+        std::vector<int> directions = {0, 8, 16, 32, 64, base.houghResolutionTheta / 2, base.houghResolutionTheta};
+        int count = (int)directions.size();
+        
+        std::vector<double> buildMs(count, 0.0);
+        std::vector<double> detectMs(count, 0.0);
+        std::vector<double> memory(count, 0.0);
+        std::vector<int> found(count, 0);
+        std::vector<int> precise(count, 0);
+        std::vector<int> recalled(count, 0);
+        float rhoTolerance = 2.0f * base.houghResolutionRho;
+        float thetaTolerance = 2.0f * CV_PI / base.houghResolutionTheta;
+        int images = 0;
+        
+        for (auto& path: paths) {
+            cv::Mat image = cv::imread(path, cv::IMREAD_COLOR);
+            if (image.empty()) {
+                std::cout << "[Benchmark] Failed to open image: " << path << std::endl;
+                continue;
+            }
+            ++images;
+            
+            std::vector<Line> reference;
+            for (int d = 0; d < count; d++) {
+                LineParams lineParams = base;
+                lineParams.runLengthDirections = directions[d];
+                LineFinder finder(lineParams);
+                
+                std::vector<double> builds;
+                std::vector<double> detects;
+                std::vector<Line> lines;
+                for (int i = 0; i < params.warmup + params.iterations; i++) {
+                    finder.process(image);
+                    double ms = measure([&]() { finder.detectNaiveLocalHough(lines); });
+                    if (i >= params.warmup) {
+                        builds.push_back(finder.preprocessTimes().runLengths);
+                        detects.push_back(ms);
+                    }
+                }
+                std::sort(builds.begin(), builds.end());
+                std::sort(detects.begin(), detects.end());
+                buildMs[d] += percentile(builds, 0.5);
+                detectMs[d] += percentile(detects, 0.5);
+                memory[d] = MAX(memory[d], (double)finder.runLengthMemory());
+                
+                if (d == 0) {
+                    reference = lines;
+                }
+                found[d] += lines.size();
+                precise[d] += countMatchingLines(lines, reference, rhoTolerance, thetaTolerance);
+                recalled[d] += countMatchingLines(reference, lines, rhoTolerance, thetaTolerance);
+            }
+        }
+        if (images == 0) {
+            return false;
+        }
+        
+        json << "{\n";
+        json << "  \"warmup\": " << params.warmup << ",\n";
+        json << "  \"iterations\": " << params.iterations << ",\n";
+        json << "  \"images\": " << images << ",\n";
+        json << "  \"directions\": {";
+        for (int d = 0; d < count; d++) {
+            double precision = found[d] > 0 ? precise[d] / (double)found[d] : 0.0;
+            double recall = found[0] > 0 ? recalled[d] / (double)found[0] : 0.0;
+            double megabytes = memory[d] / (1024.0 * 1024.0);
+            
+            json << (d > 0 ? ",\n" : "\n");
+            json << "    \"" << directions[d] << "\": {\"memoryMB\": " << megabytes
+                 << ", \"buildMs\": " << buildMs[d] / images
+                 << ", \"detectMs\": " << detectMs[d] / images
+                 << ", \"lines\": " << found[d]
+                 << ", \"precision\": " << precision
+                 << ", \"recall\": " << recall << "}";
+            
+            std::cout << "[Benchmark] " << directions[d] << " directions: " << megabytes << "MB, build "
+                      << buildMs[d] / images << "ms, naive local " << detectMs[d] / images
+                      << "ms per image, precision " << precision << ", recall " << recall << std::endl;
+        }
+        json << "\n  }\n}\n";
+        return true;
+    }
+    
+    bool runLayoutBenchmark(const BenchmarkParams& params, std::ostream& json) {
+        std::vector<cv::String> paths;
+        cv::glob(params.imageDir + "*.jpg", paths);
+        
+        const char* const layoutNames[] = {"rowMajor", "transposed"};
+        double transposeMs[2] = {0.0, 0.0};
+        double naiveMs[2] = {0.0, 0.0};
+        double standardLocalMs[2] = {0.0, 0.0};
+        int differentImages = 0;
+        int images = 0;
+        
+        json << "{\n";
+        json << "  \"warmup\": " << params.warmup << ",\n";
+        json << "  \"iterations\": " << params.iterations << ",\n";
+        json << "  \"images\": [";
+        
+        for (auto& path: paths) {
+            cv::Mat image = cv::imread(path, cv::IMREAD_COLOR);
+            if (image.empty()) {
+                std::cout << "[Benchmark] Failed to open image: " << path << std::endl;
+                continue;
+            }
+            
+            std::vector<Line> found[2];
+            json << (images > 0 ? ",\n" : "\n");
+            json << "    {\"path\": \"" << escape(path) << "\"";
+            for (int layout = 0; layout < 2; layout++) {
+                LineParams lineParams = params.lineParams;
+                lineParams.transposedWalks = layout == 1;
+                LineFinder finder(lineParams);
+                
+                std::vector<double> transposes;
+                std::vector<double> naives;
+                std::vector<double> standardLocals;
+                std::vector<Line> lines;
+                for (int i = 0; i < params.warmup + params.iterations; i++) {
+                    finder.process(image);
+                    double naive = measure([&]() { finder.detectNaiveLocalHough(found[layout]); });
+                    double standardLocal = measure([&]() { finder.detectStandardLocalHough(lines); });
+                    if (i >= params.warmup) {
+                        transposes.push_back(finder.preprocessTimes().transpose);
+                        naives.push_back(naive);
+                        standardLocals.push_back(standardLocal);
+                    }
+                }
+                std::sort(transposes.begin(), transposes.end());
+                std::sort(naives.begin(), naives.end());
+                std::sort(standardLocals.begin(), standardLocals.end());
+                transposeMs[layout] += percentile(transposes, 0.5);
+                naiveMs[layout] += percentile(naives, 0.5);
+                standardLocalMs[layout] += percentile(standardLocals, 0.5);
+                
+                json << ", \"" << layoutNames[layout] << "\": {\"transposeMs\": " << percentile(transposes, 0.5)
+                     << ", \"naiveLocalHoughMs\": " << percentile(naives, 0.5)
+                     << ", \"standardLocalHoughMs\": " << percentile(standardLocals, 0.5) << "}";
+            }
+            // Both layouts read the same pixels, so any difference is a bug
+            bool isSame = found[0].size() == found[1].size()
+                && std::equal(found[0].begin(), found[0].end(), found[1].begin(), [](const Line& a, const Line& b) {
+                    return a[0] == b[0] && a[1] == b[1] && a[2] == b[2];
+                });
+            differentImages += !isSame;
+            json << ", \"sameLines\": " << (isSame ? "true" : "false") << "}";
+            ++images;
+        }
+        json << "\n  ]\n}\n";
+        if (images == 0) {
+            return false;
+        }
+        
+        for (int layout = 0; layout < 2; layout++) {
+            std::cout << "[Benchmark] " << layoutNames[layout] << ": transpose " << transposeMs[layout] / images
+                      << "ms, naive local " << naiveMs[layout] / images
+                      << "ms, standard local " << standardLocalMs[layout] / images << "ms per image" << std::endl;
+        }
+        std::cout << "[Benchmark] Lines differ on " << differentImages << " of " << images << " images" << std::endl;
+        return true;
+    }
+}
@@ -0,0 +1,50 @@
+//
+//  Benchmark.hpp
+//  local-hough-line-cpp
+//
+//  Created by 박성현 on 17/10/2026.
+//  Copyright © 2019 Sean Park. All rights reserved.
+//
+
+#ifndef Benchmark_hpp
+#define Benchmark_hpp
+
+#include <ostream>
+#include <string>
+#include "LineFinder.hpp"
+
+namespace fh {
+    
+    class BenchmarkParams {
+    public:
+        // Every *.jpg in this directory is measured
+        std::string imageDir = "images/";
+        // Untimed runs before measuring, so caches and lazily built tables are warm
+        int warmup = 2;
+        int iterations = 10;
+        
+        LineParams lineParams;
+    };
+    
+    // Times every preprocessing stage, the two stages of the standard local Hough,
+    // and every detection mode on each image. Writes min, median and p99 in milliseconds
+    // per image and over all images as JSON, so results of two versions can be diffed.
+    // Returns false if no image could be read.
+    bool runBenchmark(const BenchmarkParams& params, std::ostream& json);
+    
+    // Runs every preprocessing option, i.e. gray first or not and each smoothing,
+    // and compares its preprocessing time and the lines of detectStandardLocalHough()
+    // against the default preprocessing. Writes the results per option as JSON.
+    bool runPreprocessBenchmark(const BenchmarkParams& params, std::ostream& json);
+    
+    // Runs detectNaiveLocalHough() with run-length transforms of several numbers of directions,
+    // and reports the memory, the time to build the transform and to detect, and the lines
+    // compared to walking pixel by pixel. Writes the results per number of directions as JSON.
+    bool runRunLengthBenchmark(const BenchmarkParams& params, std::ostream& json);
+    
+    // Runs the local Hough modes with and without LineParams::transposedWalks, and reports
+    // the time to transpose, the time to detect and whether the lines are the same, as JSON.
+    bool runLayoutBenchmark(const BenchmarkParams& params, std::ostream& json);
+}
+
+#endif /* Benchmark_hpp */
@@ -7,10 +7,11 @@
 //
 
 #include "Helper.hpp"
+#include <algorithm>
 #include <opencv2/imgproc.hpp>
 
 namespace fh {
-    cv::Size getProcessingSize(cv::Mat& image, int minLength) {
+    cv::Size getProcessingSize(const cv::Mat& image, int minLength) {
         double h = (double)image.rows;
         double w = (double)image.cols;
         
@@ -33,6 +34,86 @@ namespace fh {
         return cv::Size((int)w, (int)h);
     }
     
+    WorkerPool::WorkerPool(int threads): next(0) {
+        for (int i = 1; i < threads; i++) {
+            workers.emplace_back(&WorkerPool::loop, this);
+        }
+    }
+    
+    WorkerPool::~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& worker: workers) {
+            worker.join();
+        }
+    }
+    
+    void WorkerPool::takeChunks() {
+        for (int chunk = next++; chunk < chunkCount; chunk = next++) {
+            invoke(work, chunk);
+        }
+    }
+    
+    void WorkerPool::loop() {
+        unsigned long seen = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&]() { return stopping || job != seen; });
+                if (stopping) {
+                    return;
+                }
+                seen = job;
+            }
+            takeChunks();
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--busy == 0) {
+                done.notify_one();
+            }
+        }
+    }
+    
+    void WorkerPool::run(int chunkCount, void (*invoke)(const void* work, int chunk), const void* work) {
+        if (workers.empty() || chunkCount <= 1) {
+            for (int chunk = 0; chunk < chunkCount; chunk++) {
+                invoke(work, chunk);
+            }
+            return;
+        }
+        
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            this->invoke = invoke;
+            this->work = work;
+            this->chunkCount = chunkCount;
+            next = 0;
+            busy = (int)workers.size();
+            ++job;
+        }
+        wake.notify_all();
+        takeChunks();
+        
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [&]() { return busy == 0; });
+    }
+    
+    void packBits(const cv::Mat& image, BitMap& bits) {
+        bits.rows = image.rows;
+        bits.cols = image.cols;
+        bits.wordsPerRow = (image.cols + 63) / 64;
+        bits.words.assign(size_t(bits.rows) * bits.wordsPerRow, 0);
+        for (int y = 0; y < image.rows; y++) {
+            const uchar* src = image.ptr<uchar>(y);
+            uint64_t* dst = bits.words.data() + size_t(y) * bits.wordsPerRow;
+            for (int x = 0; x < image.cols; x++) {
+                dst[x >> 6] |= uint64_t(src[x] != 0) << (x & 63);
+            }
+        }
+    }
+    
     void releaseImage(cv::Mat** image) {
         if (image && *image) {
             (*image)->release();
@@ -64,4 +145,63 @@ namespace fh {
         pt2.y = cvRound(y0 - 1000*(a));
         cv::line(image, pt1, pt2, cv::Scalar(0xff, 0, 0), 1, cv::LINE_AA);
     }
+    
+    void renderLines(const cv::Mat& edges, const std::vector<cv::Vec3f>& lines, cv::Mat& canvas) {
+        cv::cvtColor(edges, canvas, cv::COLOR_GRAY2BGR);
+        for (auto line: lines) {
+            drawHoughLine(canvas, line);
+        }
+    }
+    
+    double percentile(const std::vector<double>& sorted, double p) {
+        if (sorted.empty()) {
+            return 0.0;
+        }
+        size_t idx = (size_t)ceil(p * sorted.size());
+        return sorted[MIN(MAX(idx, (size_t)1), sorted.size()) - 1];
+    }
+    
+    int countMatchingLines(const std::vector<cv::Vec3f>& lines, const std::vector<cv::Vec3f>& reference, float rhoTolerance, float thetaTolerance) {
+        // Every pair within the tolerances, with its distance in units of the tolerances
+        struct Pair {
+            float distance;
+            int line;
+            int ref;
+        };
+        std::vector<Pair> pairs;
+        for (int i = 0; i < (int)lines.size(); i++) {
+            for (int j = 0; j < (int)reference.size(); j++) {
+                const auto& line = lines[i];
+                const auto& ref = reference[j];
+                float dTheta = fabs(line[1] - ref[1]);
+                float dRho = fabs(line[0] - ref[0]);
+                // (rho, theta) and (-rho, theta - pi) are the same line
+                if (dTheta > CV_PI * 0.5) {
+                    dTheta = CV_PI - dTheta;
+                    dRho = fabs(line[0] + ref[0]);
+                }
+                if (dTheta <= thetaTolerance && dRho <= rhoTolerance) {
+                    float distance = dRho / MAX(rhoTolerance, 1e-6f) + dTheta / MAX(thetaTolerance, 1e-6f);
+                    pairs.push_back({distance, i, j});
+                }
+            }
+        }
+        
+        // Closest pairs first, and each line on either side is matched once
+        std::stable_sort(pairs.begin(), pairs.end(), [](const Pair& a, const Pair& b) {
+            return a.distance < b.distance;
+        });
+        std::vector<uchar> isLineMatched(lines.size(), 0);
+        std::vector<uchar> isRefMatched(reference.size(), 0);
+        int matches = 0;
+        for (auto& pair: pairs) {
+            if (isLineMatched[pair.line] || isRefMatched[pair.ref]) {
+                continue;
+            }
+            isLineMatched[pair.line] = 1;
+            isRefMatched[pair.ref] = 1;
+            ++matches;
+        }
+        return matches;
+    }
 }
@@ -12,42 +12,250 @@
 #include <iostream>
 #include <string>
 #include <chrono>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <cstdint>
 #include <opencv2/core.hpp>
 
 namespace fh {
     
-    typedef std::chrono::time_point<std::chrono::steady_clock> Time;
-    typedef std::chrono::duration<std::chrono::nanoseconds> Nanoseconds;
+    // Runs work(chunk) for every chunk in [0, chunkCount) on the given number of threads.
+    // Chunks are handed out one by one, so uneven chunks still keep every thread busy.
+    template <typename Work>
+    void parallelFor(int chunkCount, int threads, Work work) {
+        std::atomic<int> next(0);
+        auto worker = [&]() {
+            for (int chunk = next++; chunk < chunkCount; chunk = next++) {
+                work(chunk);
+            }
+        };
+        
+        std::vector<std::thread> pool;
+        for (int i = 1; i < MIN(threads, chunkCount); i++) {
+            pool.emplace_back(worker);
+        }
+        worker();
+        for (auto& thread: pool) {
+            thread.join();
+        }
+    }
+    
+    // Threads kept alive between calls, so parallel stages of every frame reuse the same threads
+    // instead of starting new ones. run() hands out chunks like parallelFor(), the calling thread
+    // takes chunks too, and it returns once every chunk is done. Neither allocates.
+    // Only one thread may call run() at a time.
+    class WorkerPool {
+        std::vector<std::thread> workers;
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::condition_variable done;
+        void (*invoke)(const void* work, int chunk) = nullptr;
+        const void* work = nullptr;
+        int chunkCount = 0;
+        std::atomic<int> next;
+        int busy = 0;               // Workers still on the current job
+        unsigned long job = 0;      // Incremented for every job, so workers tell a new job from a spurious wake up
+        bool stopping = false;
+        
+        void takeChunks();
+        void loop();
+        void run(int chunkCount, void (*invoke)(const void* work, int chunk), const void* work);
+        
+    public:
+        // threads - 1 workers are started, as the caller is one of the threads
+        explicit WorkerPool(int threads);
+        ~WorkerPool();
+        WorkerPool(const WorkerPool&) = delete;
+        WorkerPool& operator=(const WorkerPool&) = delete;
+        
+        inline int threadCount() const { return (int)workers.size() + 1; }
+        
+        // Runs work(chunk) for every chunk in [0, chunkCount)
+        template <typename Work>
+        void run(int chunkCount, const Work& work) {
+            run(chunkCount, [](const void* work, int chunk) { (*static_cast<const Work*>(work))(chunk); }, &work);
+        }
+    };
+    
+    // Queue with a fixed capacity. push() blocks while the queue is full,
+    // so a fast producer cannot run ahead of its consumers.
+    template <typename T>
+    class BlockingQueue {
+        std::mutex mutex;
+        std::condition_variable notFull;
+        std::condition_variable notEmpty;
+        std::deque<T> items;
+        size_t capacity;
+        bool closed = false;
+        
+    public:
+        BlockingQueue(size_t capacity): capacity(MAX(capacity, (size_t)1)) {}
+        
+        // Returns false if the queue was closed
+        bool push(T item) {
+            std::unique_lock<std::mutex> lock(mutex);
+            notFull.wait(lock, [&]() { return closed || items.size() < capacity; });
+            if (closed) {
+                return false;
+            }
+            items.push_back(std::move(item));
+            notEmpty.notify_one();
+            return true;
+        }
+        
+        // Returns false once the queue is closed and drained
+        bool pop(T& item) {
+            std::unique_lock<std::mutex> lock(mutex);
+            notEmpty.wait(lock, [&]() { return closed || !items.empty(); });
+            if (items.empty()) {
+                return false;
+            }
+            item = std::move(items.front());
+            items.pop_front();
+            notFull.notify_one();
+            return true;
+        }
+        
+        // No more items will be pushed. Consumers drain what is left.
+        void close() {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+            notFull.notify_all();
+            notEmpty.notify_all();
+        }
+    };
     
-    class Timer {
-        constexpr static const double million = 1000000.0;
+    // Queue with a fixed capacity between one producer thread and one consumer thread.
+    // Items move through a ring of slots without a lock: each side writes only its own count
+    // and reads the other's. A side finding the ring full or empty yields for a while, and
+    // only then sleeps until the other side wakes it, so a busy pipeline never takes the lock.
+    template <typename T>
+    class SpscQueue {
+        std::vector<T> slots;
+        // Items pushed and popped so far, on separate cache lines since two threads write them
+        std::atomic<size_t> pushed;
+        char pushedPadding[64];
+        std::atomic<size_t> popped;
+        char poppedPadding[64];
+        std::atomic<bool> closed;
+        // Sides asleep in wait(). Checked after every push and pop, so the lock is only taken to wake them.
+        std::atomic<int> sleepers;
+        std::mutex mutex;
+        std::condition_variable wakeUp;
+        
+        template <typename Ready>
+        void wait(const Ready& isReady) {
+            for (int i = 0; i < 64; i++) {
+                if (isReady()) {
+                    return;
+                }
+                std::this_thread::yield();
+            }
+            std::unique_lock<std::mutex> lock(mutex);
+            sleepers.fetch_add(1);
+            // Either this side sees the other's count, or the other side sees this sleeper
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            wakeUp.wait(lock, isReady);
+            sleepers.fetch_sub(1);
+        }
+        
+        void notify() {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (sleepers.load(std::memory_order_relaxed) > 0) {
+                std::lock_guard<std::mutex> lock(mutex);
+                wakeUp.notify_all();
+            }
+        }
+        
     public:
-        Timer(std::string name) {
-            this->name = name;
-            start();
+        SpscQueue(size_t capacity): slots(MAX(capacity, (size_t)1)), pushed(0), popped(0), closed(false), sleepers(0) {}
+        SpscQueue(const SpscQueue&) = delete;
+        SpscQueue& operator=(const SpscQueue&) = delete;
+        
+        // Producer only. Returns false if the queue was closed.
+        bool push(T item) {
+            size_t count = pushed.load(std::memory_order_relaxed);
+            wait([&]() {
+                return closed.load(std::memory_order_acquire) || count - popped.load(std::memory_order_acquire) < slots.size();
+            });
+            if (closed.load(std::memory_order_acquire)) {
+                return false;
+            }
+            slots[count % slots.size()] = std::move(item);
+            pushed.store(count + 1, std::memory_order_release);
+            notify();
+            return true;
         }
         
-        void start() {
-            timeStart = std::chrono::steady_clock::now();
+        // Consumer only. Returns false once the queue is closed and drained.
+        bool pop(T& item) {
+            size_t count = popped.load(std::memory_order_relaxed);
+            wait([&]() {
+                return closed.load(std::memory_order_acquire) || pushed.load(std::memory_order_acquire) != count;
+            });
+            // The producer closes after its last push, so the count read here is final
+            if (pushed.load(std::memory_order_acquire) == count) {
+                return false;
+            }
+            item = std::move(slots[count % slots.size()]);
+            popped.store(count + 1, std::memory_order_release);
+            notify();
+            return true;
         }
         
-        void stop() {
-            timeEnd = std::chrono::steady_clock::now();
-            auto rawElapsed = timeEnd - timeStart;
-            std::cout << "[Timer] " << name << ": " << rawElapsed.count() / million << "ms" << std::endl;
+        // No more items will be pushed. The consumer drains what is left.
+        void close() {
+            closed.store(true, std::memory_order_release);
+            std::lock_guard<std::mutex> lock(mutex);
+            wakeUp.notify_all();
         }
-    private:
-        Time timeStart;
-        Time timeEnd;
-        std::string name;
     };
     
+    // One bit per pixel, row by row. Bit x % 64 of word x / 64 of a row is pixel x.
+    struct BitMap {
+        int rows = 0;
+        int cols = 0;
+        int wordsPerRow = 0;
+        std::vector<uint64_t> words;
+        
+        inline const uint64_t* row(int y) const { return words.data() + size_t(y) * wordsPerRow; }
+    };
+    
+    // Sets the bits of the nonzero pixels. The words are reused if the size did not change.
+    void packBits(const cv::Mat& image, BitMap& bits);
     
-    cv::Size getProcessingSize(cv::Mat& image, int minLength);
+    inline int countTrailingZeros(uint64_t word) {
+        // word must not be 0
+#if defined(__GNUC__) || defined(__clang__)
+        return __builtin_ctzll(word);
+#else
+        int count = 0;
+        while ((word & 1) == 0) {
+            word >>= 1;
+            ++count;
+        }
+        return count;
+#endif
+    }
+    
+    cv::Size getProcessingSize(const cv::Mat& image, int minLength);
     
     void releaseImage(cv::Mat** image);
     void drawHoughLine(cv::Mat& image, cv::Vec3f& line);
     void drawHoughLine(cv::Mat& image, cv::Vec3d& line);
+    // Draws lines over the edge image, into canvas. canvas is reused if it already has the right size.
+    void renderLines(const cv::Mat& edges, const std::vector<cv::Vec3f>& lines, cv::Mat& canvas);
+    
+    // Nearest-rank percentile of sorted samples, p in [0, 1]. 0 if there are no samples.
+    double percentile(const std::vector<double>& sorted, double p);
+    
+    // Counts lines which have a counterpart in reference within the given tolerances.
+    // Lines are paired one to one, closest pairs first, so duplicates on either side match once.
+    int countMatchingLines(const std::vector<cv::Vec3f>& lines, const std::vector<cv::Vec3f>& reference, float rhoTolerance, float thetaTolerance);
 }
 
 
@@ -0,0 +1,100 @@
+//
+//  KernelTables.hpp
+//  local-hough-line-cpp
+//
+//  Created by 박성현 on 17/10/2026.
+//  Copyright © 2019 Sean Park. All rights reserved.
+//
+
+#ifndef KernelTables_hpp
+#define KernelTables_hpp
+
+#include <cstdint>
+
+namespace fh {
+    
+    // Same value as CV_PI, which is not usable in constant expressions everywhere
+    constexpr double kernelPi = 3.1415926535897932384626433832795;
+    
+    // Taylor series, accurate to double precision on [0, pi/4]
+    constexpr double constexprSin(double x) {
+        double term = x;
+        double sum = x;
+        for (int n = 1; n < 12; n++) {
+            term *= -x * x / ((2 * n) * (2 * n + 1));
+            sum += term;
+        }
+        return sum;
+    }
+    
+    constexpr double constexprCos(double x) {
+        double term = 1.0;
+        double sum = 1.0;
+        for (int n = 1; n < 12; n++) {
+            term *= -x * x / ((2 * n - 1) * (2 * n));
+            sum += term;
+        }
+        return sum;
+    }
+    
+    // Rounds half away from zero, like lround()
+    constexpr int64_t constexprRound(double x) {
+        return x >= 0 ? (int64_t)(x + 0.5) : -(int64_t)(-x + 0.5);
+    }
+    
+    // Fraction bits of the fixed-point entry points of FixedTrigTable
+    constexpr int rhoFractionBits = 32;
+    
+    // Angles of prepareCosSin(), generated at compile time for one theta and rho resolution.
+    // Like prepareCosSin(), only [0, pi/4] is computed and the rest is mirrored from it.
+    template <int ResolutionTheta, int ResolutionRho>
+    struct FixedTrigTable {
+        static_assert(ResolutionTheta % 4 == 0, "Mirroring needs pi/4 on a bin");
+        
+        float theta[ResolutionTheta] = {};
+        float cos[ResolutionTheta] = {};
+        float sin[ResolutionTheta] = {};
+        // Move of the entry point of a line per rho bin, i.e. ResolutionRho / cos for walks along y
+        // and ResolutionRho / sin for walks along x, with rhoFractionBits fraction bits.
+        // The entry point of rho bin r is then r * step rounded, without a division.
+        // Only set within 60 degrees of the axis, which covers the walks of LineWalkCache.
+        int64_t rhoStepY[ResolutionTheta] = {};
+        int64_t rhoStepX[ResolutionTheta] = {};
+        
+        constexpr FixedTrigTable() {
+            const int idx45 = ResolutionTheta / 4;
+            const int idx90 = ResolutionTheta / 2;
+            for (int i = 0; i < ResolutionTheta; i++) {
+                theta[i] = (float)(((float)i) / ((float)ResolutionTheta) * kernelPi);
+            }
+            for (int i = 0; i <= idx45; i++) {
+                cos[i] = (float)constexprCos(theta[i]);
+                sin[i] = (float)constexprSin(theta[i]);
+            }
+            for (int i = idx45 + 1; i <= idx90; i++) {
+                cos[i] = sin[idx90 - i];
+                sin[i] = cos[idx90 - i];
+            }
+            for (int i = idx90 + 1; i < ResolutionTheta; i++) {
+                cos[i] = -sin[i - idx90];
+                sin[i] = cos[i - idx90];
+            }
+            const double one = (double)(int64_t(1) << rhoFractionBits);
+            for (int i = 0; i < ResolutionTheta; i++) {
+                double c = cos[i];
+                double s = sin[i];
+                if (c > 0.5 || c < -0.5) {
+                    rhoStepY[i] = constexprRound(ResolutionRho / c * one);
+                }
+                if (s > 0.5 || s < -0.5) {
+                    rhoStepX[i] = constexprRound(ResolutionRho / s * one);
+                }
+            }
+        }
+    };
+    
+    template <int ResolutionTheta, int ResolutionRho>
+    constexpr FixedTrigTable<ResolutionTheta, ResolutionRho> fixedTrigTable{};
+}
+
+#endif /* KernelTables_hpp */
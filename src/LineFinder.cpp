@@ -9,10 +9,15 @@
 #include <chrono>
 #include <iostream>
 #include <string>
+#include <algorithm>
+#include <climits>
+#include <cstring>
 #include <fast_math.hpp>
 #include <opencv2/imgproc.hpp>
 #include "LineFinder.hpp"
-#include "Helper.hpp"6
+#include "KernelTables.hpp"
+#include "Helper.hpp"
+#include "Profiler.hpp"
 
 
 using namespace fh;
@@ -20,149 +25,1029 @@ using namespace fh;
 
 const float pi2 = CV_PI * 0.5f;
 
-LineFinder::LineFinder(cv::Mat* rawImage, LineParams params) {
+bool fh::parseHoughMode(const std::string& name, HoughMode& mode) {
+    if (name == "std") {
+        mode = HoughMode::Standard;
+    } else if (name == "local") {
+        mode = HoughMode::StandardLocal;
+    } else if (name == "naive") {
+        mode = HoughMode::NaiveLocal;
+    } else if (name == "fused") {
+        mode = HoughMode::FusedLocal;
+    } else if (name == "gradient") {
+        mode = HoughMode::GradientLocal;
+    } else if (name == "pyramid") {
+        mode = HoughMode::PyramidLocal;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+LineFinder::LineFinder(LineParams params) {
     this->params = params;
-    cv::Size size = getProcessingSize(*rawImage, params.worksheetLength);
-    this->_diagonalLength = hypot(size.width, size.height);
-    this->_diagonalAngle = atan2(rawImage->size[1], rawImage->size[0]);
+    prepareCosSin(_trigs);
+}
+
+LineFinder::LineFinder(cv::Mat* rawImage, LineParams params): LineFinder(params) {
+    process(*rawImage);
+}
+
+// Buffers are sized on the first frame, and reused as long as the frames keep their size.
+void LineFinder::process(const uchar* luma, cv::Size size, size_t stride) {
+    // Only a header over the caller's memory
+    cv::Mat frame(size, CV_8UC1, const_cast<uchar*>(luma), stride);
+    process(frame);
+}
+
+void LineFinder::process(const cv::Mat& frame) {
+    cv::Size size = getProcessingSize(frame, params.worksheetLength);
+    this->_diagonalAngle = atan2(frame.size[1], frame.size[0]);
+    
+    if (!_walks || _walks->size() != size) {
+        this->_diagonalLength = hypot(size.width, size.height);
+        
+        // Tracked lines belong to the old size
+        resetTracking();
+        
+        // Shared with every LineFinder working on the same size
+        _walks = LineWalkCache::get(size, params.houghResolutionTheta);
+        
+        // Rhos for runNaiveLocalHough()
+        int H = (int)diagonalLength();
+        int rhoCount = floor(H / ((float)params.houghResolutionRho));
+        _rhos.clear();
+        for (int r = -rhoCount; r <= rhoCount; r++) {
+            _rhos.push_back(r * ((float)params.houghResolutionRho));
+        }
+    }
     
-    preprocess(rawImage);
+    // Only a header, so no pixels are copied
+    _frame = frame;
+    preprocess(frame);
 }
 
-LineFinder::~LineFinder() {
-    releaseImage(&_worksheet);
-    releaseImage(&_result);
+cv::Mat LineFinder::runStandardHough() {
+    detectStandardHough(_lines);
+    cv::Mat result;
+    renderLines(_worksheet, _lines, result);
+    return result;
+}
+
+cv::Mat LineFinder::runStandardLocalHough() {
+    detectStandardLocalHough(_lines);
+    cv::Mat result;
+    renderLines(_worksheet, _lines, result);
+    return result;
+}
+
+cv::Mat LineFinder::runNaiveLocalHough() {
+    detectNaiveLocalHough(_lines);
+    cv::Mat result;
+    renderLines(_worksheet, _lines, result);
+    return result;
+}
+
+cv::Mat LineFinder::runFusedLocalHough() {
+    detectFusedLocalHough(_lines);
+    cv::Mat result;
+    renderLines(_worksheet, _lines, result);
+    return result;
+}
+
+cv::Mat LineFinder::runGradientLocalHough() {
+    detectGradientLocalHough(_lines);
+    cv::Mat result;
+    renderLines(_worksheet, _lines, result);
+    return result;
+}
+
+cv::Mat LineFinder::runLocalSegments() {
+    detectLocalSegments(_segments);
+    cv::Mat result;
+    cv::cvtColor(_worksheet, result, cv::COLOR_GRAY2BGR);
+    for (auto& segment: _segments) {
+        cv::Point begin(cvRound(segment.begin.x), cvRound(segment.begin.y));
+        cv::Point end(cvRound(segment.end.x), cvRound(segment.end.y));
+        cv::line(result, begin, end, cv::Scalar(0xff, 0, 0), 1, cv::LINE_AA);
+    }
+    return result;
+}
+
+void LineFinder::detect(HoughMode mode, std::vector<Line>& lines) {
+    switch (mode) {
+        case HoughMode::Standard:
+            detectStandardHough(lines);
+            break;
+        case HoughMode::StandardLocal:
+            detectStandardLocalHough(lines);
+            break;
+        case HoughMode::NaiveLocal:
+            detectNaiveLocalHough(lines);
+            break;
+        case HoughMode::FusedLocal:
+            detectFusedLocalHough(lines);
+            break;
+        case HoughMode::GradientLocal:
+            detectGradientLocalHough(lines);
+            break;
+        case HoughMode::PyramidLocal:
+            detectPyramidLocalHough(lines);
+            break;
+    }
 }
 
 // https://docs.opencv.org/4.1.0/d5/df9/samples_2cpp_2tutorial_code_2ImgTrans_2houghlines_8cpp-example.html#a8
-cv::Mat& LineFinder::runStandardHough() {
-    releaseImage(&_result);
+void LineFinder::detectStandardHough(std::vector<Line>& lines) {
+    FH_PROFILE_SCOPE("Standard Hough");
     
-    Timer timer("Standard Hough");
+    detectCandidates(lines);
+}
+
+void LineFinder::detectStandardLocalHough(std::vector<Line>& lines) {
+    FH_PROFILE_SCOPE("Standard Local Hough");
     
-    std::vector<cv::Vec3f> lines;
-    cv::HoughLines(*_worksheet,
-                   lines,
-                   params.houghResolutionRho,
-                   CV_PI / params.houghResolutionTheta,
-                   params.houghThreshold());
+    detectCandidates(_candidates);
+    suppressCandidates(_candidates);
+    filterByLocality(_candidates, lines);
+}
+
+bool LineFinder::detectAnytimeLocalHough(double budgetMs, std::vector<Line>& lines) {
+    auto budget = std::chrono::duration<double, std::milli>(budgetMs);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(budget);
+    return detectAnytimeLocalHough(deadline, lines);
+}
+
+bool LineFinder::detectAnytimeLocalHough(std::chrono::steady_clock::time_point deadline, std::vector<Line>& lines) {
+    FH_PROFILE_SCOPE("Anytime Local Hough");
     
-    timer.stop();
+    lines.clear();
+    detectCandidates(_candidates);
+    suppressCandidates(_candidates);
+    auto& candidates = _candidates;
+    // Most voted first, which is what makes stopping early safe
+    std::sort(candidates.begin(), candidates.end(), isMoreVoted);
     
-    _result = new cv::Mat(_worksheet->size(), CV_8UC3);
-    cv::cvtColor(*_worksheet, *_result, cv::COLOR_GRAY2BGR);
+    int localThreshold = params.houghLocalThreshold();
+    for (size_t i = 0; i < candidates.size(); i++) {
+        // One test takes microseconds, so the deadline is missed by one test at most
+        if (std::chrono::steady_clock::now() >= deadline) {
+            FH_COUNT(CandidateLines, i);
+            return false;
+        }
+        
+        Line line;
+        int angleIdx = cvRound(candidates[i][1] * params.houghResolutionTheta / CV_PI) % params.houghResolutionTheta;
+        if (testLocality(angleIdx, candidates[i][0], line, localThreshold)) {
+            lines.push_back(line);
+        }
+    }
+    FH_COUNT(CandidateLines, candidates.size());
+    return true;
+}
+
+void LineFinder::detectLocalSegments(std::vector<Segment>& segments) {
+    FH_PROFILE_SCOPE("Local Segments");
+    
+    detectCandidates(_candidates);
+    suppressCandidates(_candidates);
+    FH_COUNT(CandidateLines, _candidates.size());
+    findSegments(_candidates, segments);
+}
+
+void LineFinder::findSegments(const std::vector<Line>& lines, std::vector<Segment>& segments) {
+    segments.clear();
+    int localThreshold = params.houghLocalThreshold();
+    for (auto& candidate: lines) {
+        Line line;
+        int angleIdx = cvRound(candidate[1] * params.houghResolutionTheta / CV_PI) % params.houghResolutionTheta;
+        didFindLine(_walks->walk(angleIdx), candidate[0], _trigs[angleIdx], line, localThreshold, &segments);
+    }
+}
+
+// The vote of cv::HoughLines, on an accumulator kept from frame to frame. cv::HoughLines allocates
+// its accumulator, tables and peaks on every call.
+void LineFinder::detectCandidates(std::vector<Line>& candidates) {
+    auto& votes = _houghVotes;
+    const int numrho = prepareVotes();
+    const int thetaCount = (int)_houghSin.size();
+    const float* tabSin = _houghSin.data();
+    const float* tabCos = _houghCos.data();
+    for (int y = 0; y < _worksheet.rows; y++) {
+        const uchar* edgeRow = _worksheet.ptr<uchar>(y);
+        for (int x = 0; x < _worksheet.cols; x++) {
+            if (edgeRow[x] == 0) {
+                continue;
+            }
+            for (int n = 0; n < thetaCount; n++) {
+                int r = cvRound(x * tabCos[n] + y * tabSin[n]) + (numrho - 1) / 2;
+                ++votes[(n + 1) * (numrho + 2) + r + 1];
+            }
+        }
+    }
+    findPeaks(numrho, candidates);
+}
+
+// HoughLinesStandard() of OpenCV 4 keeps (numangle + 2) x (numrho + 2) cells, with empty cells
+// around the border, and angles stepped in float. numangle is cvRound(CV_PI / thetaStep), i.e. houghResolutionTheta.
+int LineFinder::prepareVotes() {
+    const int thetaCount = params.houghResolutionTheta;
+    const float rhoStep = (float)params.houghResolutionRho;
+    const float thetaStep = (float)(CV_PI / params.houghResolutionTheta);
+    const float irho = 1 / rhoStep;
+    const int numrho = cvRound(((_worksheet.cols + _worksheet.rows) * 2 + 1) / rhoStep);
+    auto& tabSin = _houghSin;
+    auto& tabCos = _houghCos;
+    tabSin.resize(thetaCount);
+    tabCos.resize(thetaCount);
+    float angle = 0.0f;
+    for (int n = 0; n < thetaCount; angle += thetaStep, n++) {
+        tabSin[n] = (float)(sin((double)angle) * irho);
+        tabCos[n] = (float)(cos((double)angle) * irho);
+    }
+    _houghVotes.assign((thetaCount + 2) * (numrho + 2), 0);
+    return numrho;
+}
 
-    for (auto& line: lines) {
-        drawHoughLine(*_result, line);
+// Local maxima, in the order and with the tie break of cv::HoughLines
+void LineFinder::findPeaks(int numrho, std::vector<Line>& candidates) {
+    const int thetaCount = params.houghResolutionTheta;
+    const int threshold = params.houghThreshold();
+    const float rhoStep = (float)params.houghResolutionRho;
+    const float thetaStep = (float)(CV_PI / params.houghResolutionTheta);
+    auto& votes = _houghVotes;
+    auto& peaks = _houghPeaks;
+    peaks.clear();
+    for (int r = 0; r < numrho; r++) {
+        for (int n = 0; n < thetaCount; n++) {
+            int idx = (n + 1) * (numrho + 2) + r + 1;
+            int v = votes[idx];
+            if (v > threshold &&
+                v > votes[idx - 1] && v >= votes[idx + 1] &&
+                v > votes[idx - numrho - 2] && v >= votes[idx + numrho + 2]) {
+                peaks.push_back(idx);
+            }
+        }
     }
+    std::sort(peaks.begin(), peaks.end(), [&](int a, int b) {
+        return votes[a] > votes[b] || (votes[a] == votes[b] && a < b);
+    });
     
-    return *_result;
+    candidates.clear();
+    for (int idx: peaks) {
+        int n = idx / (numrho + 2) - 1;
+        int r = idx - (n + 1) * (numrho + 2) - 1;
+        candidates.push_back(Line((r - (numrho - 1) * 0.5f) * rhoStep, n * thetaStep, (float)votes[idx]));
+    }
 }
 
-cv::Mat& LineFinder::runStandardLocalHough() {
-    releaseImage(&_result);
+// The order of cv::HoughLines, with ties in theta and then rho order. Unlike std::stable_sort,
+// std::sort with it takes no buffer.
+bool LineFinder::isMoreVoted(const Line& a, const Line& b) {
+    if (a[2] != b[2]) {
+        return a[2] > b[2];
+    }
+    return a[1] < b[1] || (a[1] == b[1] && a[0] < b[0]);
+}
+
+// Greedy non-maximum suppression in (rho, theta). Candidates are visited from the most voted one,
+// and hashed into cells one bin larger than the merge radius, so each is compared with the kept
+// candidates of the 3 x 3 cells around it only. Theta wraps around at PI, where rho changes its sign.
+void LineFinder::suppressCandidates(std::vector<Line>& candidates) {
+    int radiusRho = params.candidateMergeRho;
+    int radiusTheta = params.candidateMergeTheta;
+    if (radiusRho <= 0 || radiusTheta <= 0 || candidates.size() < 2) {
+        return;
+    }
+    // The votes of this file come sorted already, so this moves nothing
+    std::sort(candidates.begin(), candidates.end(), isMoreVoted);
     
-    Timer timer("Standard Local Hough");
+    float rhoBin = params.houghResolutionRho;
+    float thetaBin = CV_PI / params.houghResolutionTheta;
+    // A candidate exactly at the radius may round into the next cell, so cells take a bin more
+    float rhoCell = (radiusRho + 1) * rhoBin;
+    float thetaCell = (radiusTheta + 1) * thetaBin;
+    auto& cells = _candidateCells;
+    auto& heads = _candidateHeads;
+    auto& next = _candidateNext;
+    // At most one cell per candidate, so the table is never more than half full
+    size_t slots = 16;
+    while (slots < 2 * candidates.size()) {
+        slots <<= 1;
+    }
+    cells.assign(slots, 0);
+    heads.assign(slots, -1);
+    next.clear();
     
-    std::vector<cv::Vec3f> lines;
-    cv::HoughLines(*_worksheet,
-                   lines,
-                   params.houghResolutionRho,
-                   CV_PI / params.houghResolutionTheta,
-                   params.houghThreshold());
+    auto cellOf = [&](float rho, float theta, int dRho, int dTheta) {
+        int64_t r = (int64_t)std::floor(rho / rhoCell) + dRho;
+        int64_t t = (int64_t)std::floor(theta / thetaCell) + dTheta;
+        return (int64_t)(((uint64_t)r << 32) ^ (uint32_t)t);
+    };
+    // Slot of the cell, or the empty slot where it would go
+    auto slotOf = [&](int64_t cell) {
+        size_t slot = (size_t)(((uint64_t)cell * 0x9E3779B97F4A7C15ull) >> 32) & (slots - 1);
+        while (heads[slot] >= 0 && cells[slot] != cell) {
+            slot = (slot + 1) & (slots - 1);
+        }
+        return slot;
+    };
+    // Candidates are kept in place, so kept indices are below the one being visited
+    auto isNearKept = [&](float rho, float theta) {
+        for (int dRho = -1; dRho <= 1; dRho++) {
+            for (int dTheta = -1; dTheta <= 1; dTheta++) {
+                size_t slot = slotOf(cellOf(rho, theta, dRho, dTheta));
+                for (int k = heads[slot]; k >= 0; k = next[k]) {
+                    float binsRho = fabs(candidates[k][0] - rho) / rhoBin;
+                    float binsTheta = fabs(candidates[k][1] - theta) / thetaBin;
+                    if (binsRho <= radiusRho + 1e-3f && binsTheta <= radiusTheta + 1e-3f) {
+                        return true;
+                    }
+                }
+            }
+        }
+        return false;
+    };
     
+    int kept = 0;
+    for (size_t i = 0; i < candidates.size(); i++) {
+        Line line = candidates[i];
+        bool isMerged = isNearKept(line[0], line[1])
+            || (line[1] < thetaCell && isNearKept(-line[0], line[1] + CV_PI))
+            || (line[1] > CV_PI - thetaCell && isNearKept(-line[0], line[1] - CV_PI));
+        if (isMerged) {
+            continue;
+        }
+        
+        int64_t cell = cellOf(line[0], line[1], 0, 0);
+        size_t slot = slotOf(cell);
+        next.push_back(heads[slot]);
+        cells[slot] = cell;
+        heads[slot] = kept;
+        candidates[kept++] = line;
+    }
+    FH_COUNT(MergedCandidates, candidates.size() - kept);
+    candidates.resize(kept);
+}
+
+void LineFinder::filterByLocality(const std::vector<Line>& candidates, std::vector<Line>& lines) {
     // Filter candidate lines by testing locality
-    // Prepare trigonometric function table for faster calculation
-    std::vector<Angle> trigs;
-    prepareCosSin(trigs);
-    
     // Test each line for locality
     int localThreshold = params.houghLocalThreshold();
-    std::vector<Line> realLines;
-    for (auto& line: lines) {
+    lines.clear();
+    FH_COUNT(CandidateLines, candidates.size());
+    for (auto& line: candidates) {
         Line realLine;
         
-        // Get precaculated cos, sin values
-        int angleIdx = cvRound(line[1] * params.houghResolutionTheta / CV_PI);
-        auto& angle = trigs[angleIdx];
+        // Index of the precalculated cos, sin values
+        int angleIdx = cvRound(line[1] * params.houghResolutionTheta / CV_PI) % params.houghResolutionTheta;
         
         // Locality is defined as such:
         //   If there exists a group of consecutive pixels along the line,
         //   then that 'candidate line' is locally a line.
         //   We decide the consecutivity by thresholding, i.e. over T pixels should be consecutive.
-        if (didFindLine(_worksheet, line[0], angle, realLine, localThreshold)) {
-            realLines.push_back(realLine);
+        if (testLocality(angleIdx, line[0], realLine, localThreshold)) {
+            lines.push_back(realLine);
         }
     }
+}
+
+void LineFinder::detectNaiveLocalHough(std::vector<Line>& lines) {
+    FH_PROFILE_SCOPE("Naive Local Hough");
     
-    timer.stop();
+    int threshold = params.houghLocalThreshold();
+    // The run-length transform replaces walking altogether
+    bool lockstep = params.lockstepWalk && _runLengths.empty();
+    ThetaScan scan = _runLengths.empty() ? thetaScan() : &LineFinder::scanThetas;
     
+    // Every (rho, theta) pair is independent, so split thetas into chunks and test them in parallel.
+    // Each chunk owns its buffer, and buffers are merged in theta order,
+    // so the result does not depend on the number of threads.
+    int threads = pool().threadCount();
+    int thetaCount = (int)_trigs.size();
+    int chunkCount = MIN(thetaCount, threads * 8);
+    auto& buffers = _buffers;
+    buffers.resize(chunkCount);
+    for (auto& buffer: buffers) {
+        buffer.clear();
+    }
     
-    _result = new cv::Mat(_worksheet->size(), CV_8UC3);
-    cv::cvtColor(*_worksheet, *_result, cv::COLOR_GRAY2BGR);
+    pool().run(chunkCount, [&](int chunk) {
+        int thetaBegin = chunk * thetaCount / chunkCount;
+        int thetaEnd = (chunk + 1) * thetaCount / chunkCount;
+        long long rejected = 0;
+        (this->*scan)(thetaBegin, thetaEnd, threshold, lockstep, buffers[chunk], rejected);
+        FH_COUNT(RejectedPairs, rejected);
+        FH_COUNT_FLUSH();
+    });
     
-    for (auto& line: realLines) {
-        drawHoughLine(*_result, line);
+    lines.clear();
+    for (int chunk = 0; chunk < chunkCount; chunk++) {
+        lines.insert(lines.end(), buffers[chunk].begin(), buffers[chunk].end());
     }
-    
-    return *_result;
 }
 
-cv::Mat& LineFinder::runNaiveLocalHough() {
-    releaseImage(&_result);
-    
-    Timer timer("Naive Local Hough");
-    
-    // Prepare cos, sin
-    std::vector<Angle> trigs;
-    prepareCosSin(trigs);
-    
-    // Prepare rhos
-    int H = (int)diagonalLength();
-    int rhoCount = floor(H / ((float)params.houghResolutionRho));
-    std::vector<float> rhos;
-    for (int r = -rhoCount; r <= rhoCount; r++) {
-        rhos.push_back(r * ((float)params.houghResolutionRho));
-    }
+// Tests every meaningful rho of the thetas in [thetaBegin, thetaEnd), for any resolution
+void LineFinder::scanThetas(int thetaBegin, int thetaEnd, int threshold, bool lockstep, std::vector<Line>& lines, long long& rejected) {
+    auto& trigs = _trigs;
+    auto& rhos = _rhos;
+    float diagonalAngle = atan2(_worksheet.rows, _worksheet.cols);
+    cv::Size imgSize = cv::Size(_worksheet.cols, _worksheet.rows);
     
-    float diagonalAngle = atan2(_worksheet->rows, _worksheet->cols);
-    cv::Size imgSize = cv::Size(_worksheet->cols, _worksheet->rows);
-    int threshold = params.houghLocalThreshold();
-    
-    std::vector<Line> lines;
     // Iterate for theta
-    for (auto& theta: trigs) {
+    for (int t = thetaBegin; t < thetaEnd; t++) {
+        auto& theta = trigs[t];
+        const LineWalk& walk = _walks->walk(t);
+        double tcos = theta[1];
+        double tsin = theta[2];
+        // Walks along bit-packed rows beat walking bytes in lockstep
+        bool isLockstep = lockstep && !layoutOf(walk).bits;
+        float lanes[lockstepLanes];
+        int bases[lockstepLanes];
+        int laneCount = 0;
+        
         // Iterate for rho
         for (auto& rho: rhos) {
             // Check if this rho and theta is meaningful
             bool isMeaningful = isFindingMeaningful(imgSize, rho, theta, diagonalAngle);
             if (!isMeaningful) {
+                ++rejected;
+                continue;
+            }
+            
+            if (isLockstep) {
+                // Same entry point as didFindLine()
+                lanes[laneCount] = rho;
+                bases[laneCount] = cvRound(walk.alongY ? rho / tcos : rho / tsin);
+                if (++laneCount == lockstepLanes) {
+                    testLocalityLockstep(t, lanes, bases, laneCount, threshold, lines);
+                    laneCount = 0;
+                }
                 continue;
             }
             
             Line line;
             // If success to find a line, append it
-            bool didFind = didFindLine(_worksheet, rho, theta, line, threshold);
+            bool didFind = testLocality(t, rho, line, threshold);
             if (didFind) {
                 lines.push_back(line);
             }
         }
+        if (laneCount > 0) {
+            testLocalityLockstep(t, lanes, bases, laneCount, threshold, lines);
+        }
+    }
+}
+
+// Same scan as scanThetas(), specialized on the resolutions. Angles come from a table built
+// at compile time, the bounds of isFindingMeaningful() are computed once per theta,
+// and the entry point of each rho steps in fixed point instead of dividing by cos or sin.
+template <int ResolutionTheta, int ResolutionRho>
+void LineFinder::scanThetasFixed(int thetaBegin, int thetaEnd, int threshold, bool lockstep, std::vector<Line>& lines, long long& rejected) {
+    const auto& table = fixedTrigTable<ResolutionTheta, ResolutionRho>;
+    const float diagonalAngle = atan2(_worksheet.rows, _worksheet.cols);
+    const float width = _worksheet.cols;
+    const float height = _worksheet.rows;
+    const int rhoCount = (int)_rhos.size() / 2;
+    const int64_t half = int64_t(1) << (rhoFractionBits - 1);
+    
+    for (int t = thetaBegin; t < thetaEnd; t++) {
+        const LineWalk& walk = _walks->walk(t);
+        const float theta = table.theta[t];
+        const float tcos = table.cos[t];
+        const float tsin = table.sin[t];
+        
+        // isFindingMeaningful() of this theta: rho < upper for rho >= 0, and lower <= rho below 0
+        const float upper = theta < diagonalAngle ? width / tcos : height * tsin;
+        const bool hasNegative = theta >= pi2;
+        const float lower = theta < (pi2 + diagonalAngle) ? -height * tsin : width * tcos;
+        
+        const int64_t step = walk.alongY ? table.rhoStepY[t] : table.rhoStepX[t];
+        bool isLockstep = lockstep && !layoutOf(walk).bits;
+        float lanes[lockstepLanes];
+        int bases[lockstepLanes];
+        int laneCount = 0;
+        
+        for (int r = -rhoCount; r <= rhoCount; r++) {
+            float rho = r * (float)ResolutionRho;
+            bool isMeaningful = rho >= 0 ? rho < upper : (hasNegative && rho >= lower);
+            if (!isMeaningful) {
+                ++rejected;
+                continue;
+            }
+            
+            int base = (int)((r * step + half) >> rhoFractionBits);
+            if (isLockstep) {
+                lanes[laneCount] = rho;
+                bases[laneCount] = base;
+                if (++laneCount == lockstepLanes) {
+                    testLocalityLockstep(t, lanes, bases, laneCount, threshold, lines);
+                    laneCount = 0;
+                }
+                continue;
+            }
+            
+            Line line(rho, theta, 0);
+            if (didFindLineFrom(walk, base, line, threshold)) {
+                lines.push_back(line);
+            }
+        }
+        if (laneCount > 0) {
+            testLocalityLockstep(t, lanes, bases, laneCount, threshold, lines);
+        }
+    }
+}
+
+// Resolutions with a specialized scan. Anything else takes scanThetas().
+LineFinder::ThetaScan LineFinder::thetaScan() const {
+    if (!params.specializedKernels) {
+        return &LineFinder::scanThetas;
+    }
+    int theta = params.houghResolutionTheta;
+    int rho = params.houghResolutionRho;
+    if (theta == 180 && rho == 1) {
+        return &LineFinder::scanThetasFixed<180, 1>;
+    }
+    if (theta == 360 && rho == 1) {
+        return &LineFinder::scanThetasFixed<360, 1>;
+    }
+    if (theta == 180 && rho == 2) {
+        return &LineFinder::scanThetasFixed<180, 2>;
+    }
+    if (theta == 360 && rho == 2) {
+        return &LineFinder::scanThetasFixed<360, 2>;
+    }
+    return &LineFinder::scanThetas;
+}
+
+void LineFinder::detectFusedLocalHough(std::vector<Line>& lines) {
+    FH_PROFILE_SCOPE("Fused Local Hough");
+    
+    voteFused(lines);
+}
+
+// Votes and tests locality in a single pass over the pixels, with the lines of detectStandardLocalHough().
+// Pixels are visited along the major axis of each walk, i.e. rows for near-vertical lines and columns
+// for near-horizontal lines. The pixel at step s and minor position m lies on the walk of theta entering
+// at m - minor[s], and on no other walk of theta, so each walk of didFindLine() is a cell which sees its
+// pixels in the order the walk reads them, and closes its run as soon as a step is skipped.
+// Edge pixels also vote into the accumulator of detectCandidates(), so the candidates are the same.
+// Their walks are then looked up, not walked.
+void LineFinder::voteFused(std::vector<Line>& lines) {
+    typedef FusedCell Cell;
+    typedef FusedPixel Pixel;
+    
+    auto& trigs = _trigs;
+    lines.clear();
+    
+    const int thetaCount = (int)trigs.size();
+    const int localThreshold = params.houghLocalThreshold();
+    
+    auto& votes = _houghVotes;
+    const int numrho = prepareVotes();
+    const float* tabSin = _houghSin.data();
+    const float* tabCos = _houghCos.data();
+    
+    // Collect every pixel which didFindLine() would count as a line pixel. Edge pixels are among them.
+    // Row major order serves near-vertical lines, column major order near-horizontal lines.
+    auto& byRow = _fusedByRow;
+    auto& byCol = _fusedByCol;
+    byRow.clear();
+    byCol.clear();
+    for (int y = 0; y < _nearEdge.rows; y++) {
+        const uchar* edgeRow = _worksheet.ptr<uchar>(y);
+        const uchar* nearEdgeRow = _nearEdge.ptr<uchar>(y);
+        for (int x = 0; x < _nearEdge.cols; x++) {
+            if (nearEdgeRow[x] != 0) {
+                byRow.push_back({x, y, edgeRow[x] != 0});
+            }
+        }
+    }
+    for (int x = 0; x < _nearEdge.cols; x++) {
+        for (int y = 0; y < _nearEdge.rows; y++) {
+            if (_nearEdge.at<uchar>(y, x) != 0) {
+                byCol.push_back({x, y, _worksheet.at<uchar>(y, x) != 0});
+            }
+        }
+    }
+    
+    // Cells of theta t start at baseOffsets[t] - the smallest entry point of a walk inside the image
+    auto& verticals = _fusedVerticals;
+    auto& horizontals = _fusedHorizontals;
+    auto& baseOffsets = _fusedBaseOffsets;
+    verticals.clear();
+    horizontals.clear();
+    baseOffsets.resize(thetaCount);
+    int cellCount = 0;
+    for (int t = 0; t < thetaCount; t++) {
+        const LineWalk& walk = _walks->walk(t);
+        (walk.alongY ? verticals : horizontals).push_back(t);
+        int lowest = MIN(walk.minor.front(), walk.minor.back());
+        int highest = MAX(walk.minor.front(), walk.minor.back());
+        baseOffsets[t] = cellCount + highest;
+        cellCount += walk.minorLength + highest - lowest;
+    }
+    
+    auto& cells = _fusedCells;
+    cells.assign(cellCount, Cell());
+    auto vote = [&](const std::vector<Pixel>& pixels, const std::vector<int>& thetas, bool alongY) {
+        for (auto& p: pixels) {
+            int step = alongY ? p.y : p.x;
+            int position = alongY ? p.x : p.y;
+            for (int t: thetas) {
+                if (p.isEdge) {
+                    int r = cvRound(p.x * tabCos[t] + p.y * tabSin[t]) + (numrho - 1) / 2;
+                    ++votes[(t + 1) * (numrho + 2) + r + 1];
+                }
+                
+                Cell& cell = cells[baseOffsets[t] + position - _walks->walk(t).minor[step]];
+                if (cell.last == step - 1) {
+                    ++cell.run;
+                } else {
+                    if (cell.run > localThreshold) {
+                        cell.score += cell.run;
+                    }
+                    cell.run = 1;
+                }
+                cell.last = step;
+            }
+        }
+    };
+    vote(byRow, verticals, true);
+    vote(byCol, horizontals, false);
+    
+    auto& candidates = _candidates;
+    findPeaks(numrho, candidates);
+    suppressCandidates(candidates);
+    
+    // The locality test of filterByLocality(), reading the score of each walk from its cell
+    FH_COUNT(CandidateLines, candidates.size());
+    for (auto& candidate: candidates) {
+        int angleIdx = cvRound(candidate[1] * params.houghResolutionTheta / CV_PI) % params.houghResolutionTheta;
+        const LineWalk& walk = _walks->walk(angleIdx);
+        const Angle& theta = trigs[angleIdx];
+        double tcos = theta[1];
+        double tsin = theta[2];
+        int base = cvRound(walk.alongY ? candidate[0] / tcos : candidate[0] / tsin);
+        int begin = 0;
+        int end = 0;
+        walk.clip(base, begin, end);
+        if (end - begin <= localThreshold) {
+            continue;
+        }
+        
+        // The run still open reached the border unless a step inside the image closed it
+        const Cell& cell = cells[baseOffsets[angleIdx] + base];
+        int score = cell.score;
+        if (cell.run > localThreshold && (cell.last < end - 1 || params.countBorderRuns)) {
+            score += cell.run;
+        }
+        if (score > localThreshold) {
+            lines.push_back(Line(candidate[0], theta[0], score));
+        }
+    }
+}
+
+void LineFinder::detectGradientLocalHough(std::vector<Line>& lines) {
+    FH_PROFILE_SCOPE("Gradient Local Hough");
+    
+    voteGradient(_candidates);
+    filterByLocality(_candidates, lines);
+}
+
+// Votes like cv::HoughLines, except that each edge pixel votes only for the thetas
+// near its gradient direction. The gradient is the normal of the edge, so a pixel on
+// a line votes for the line's theta anyway, and the other votes were noise.
+void LineFinder::voteGradient(std::vector<Line>& candidates) {
+    auto& trigs = _trigs;
+    candidates.clear();
+    
+    const int thetaCount = (int)trigs.size();
+    const float rhoScale = 1.0f / params.houghResolutionRho;
+    const int rhoOffset = (int)ceil(diagonalLength() * rhoScale);
+    const int rhoCount = 2 * rhoOffset + 1;
+    const int threshold = params.houghThreshold();
+    const int window = MIN(MAX(params.gradientWindowTheta, 0), (thetaCount - 1) / 2);
+    
+    // Same derivatives as cv::Canny takes internally
+    if (!_hasGradient) {
+        FH_PROFILE_SCOPE("Sobel");
+        cv::Sobel(_gray, _dx, CV_16S, 1, 0, params.cannyAperture, 1, 0, cv::BORDER_REPLICATE);
+        cv::Sobel(_gray, _dy, CV_16S, 0, 1, params.cannyAperture, 1, 0, cv::BORDER_REPLICATE);
+        _hasGradient = true;
+    }
+    
+    auto& votes = _gradientVotes;
+    votes.assign(thetaCount * rhoCount, 0);
+    for (int y = 0; y < _worksheet.rows; y++) {
+        const uchar* edgeRow = _worksheet.ptr<uchar>(y);
+        const short* dxRow = _dx.ptr<short>(y);
+        const short* dyRow = _dy.ptr<short>(y);
+        for (int x = 0; x < _worksheet.cols; x++) {
+            if (edgeRow[x] == 0) {
+                continue;
+            }
+            // Gradient direction in [0, 360) degrees. theta and theta + 180 share a bin.
+            float degree = cv::fastAtan2(dyRow[x], dxRow[x]);
+            int center = cvRound(degree * thetaCount / 180.0f) % thetaCount;
+            for (int d = -window; d <= window; d++) {
+                int t = (center + d + thetaCount) % thetaCount;
+                auto& angle = trigs[t];
+                int r = cvRound((x * angle[1] + y * angle[2]) * rhoScale) + rhoOffset;
+                ++votes[t * rhoCount + r];
+            }
+        }
+    }
+    
+    // Local maxima like cv::HoughLines
+    auto& peaks = _gradientPeaks;
+    peaks.clear();
+    for (int t = 0; t < thetaCount; t++) {
+        for (int r = 0; r < rhoCount; r++) {
+            int idx = t * rhoCount + r;
+            int v = votes[idx];
+            if (v <= threshold) {
+                continue;
+            }
+            if ((r > 0 && v <= votes[idx - 1]) ||
+                (r < rhoCount - 1 && v < votes[idx + 1]) ||
+                (t > 0 && v <= votes[idx - rhoCount]) ||
+                (t < thetaCount - 1 && v < votes[idx + rhoCount])) {
+                continue;
+            }
+            peaks.push_back(idx);
+        }
+    }
+    std::sort(peaks.begin(), peaks.end(), [&](int a, int b) {
+        if (votes[a] != votes[b]) {
+            return votes[a] > votes[b];
+        }
+        return a < b;
+    });
+    
+    for (int idx: peaks) {
+        int t = idx / rhoCount;
+        int r = idx % rhoCount;
+        candidates.push_back(Line((r - rhoOffset) * params.houghResolutionRho, trigs[t][0], votes[idx]));
     }
+}
+
+void LineFinder::detectPyramidLocalHough(std::vector<Line>& lines) {
+    FH_PROFILE_SCOPE("Pyramid Local Hough");
     
-    timer.stop();
+    // Coarse lines from the worksheet
+    detectStandardLocalHough(_coarseLines);
     
-    // Plot
-    _result = new cv::Mat(_worksheet->size(), CV_8UC3);
-    cv::cvtColor(*_worksheet, *_result, cv::COLOR_GRAY2BGR);
+    // Every line is refined independently, in a strip of its own.
+    // Chunks take every threads-th line, so each chunk owns one strip buffer.
+    int threads = MIN(pool().threadCount(), MAX(1, (int)_coarseLines.size()));
+    _strips.resize(threads);
+    _refined.resize(_coarseLines.size());
+    _refinedFound.assign(_coarseLines.size(), 0);
+    pool().run(threads, [&](int chunk) {
+        for (size_t i = chunk; i < _coarseLines.size(); i += threads) {
+            _refinedFound[i] = refineLine(_coarseLines[i], _strips[chunk], _refined[i]);
+        }
+    });
     
-    for (auto& line: lines) {
-        drawHoughLine(*_result, line);
+    lines.clear();
+    for (size_t i = 0; i < _refined.size(); i++) {
+        if (_refinedFound[i]) {
+            lines.push_back(_refined[i]);
+        }
+    }
+}
+
+// Refines a worksheet line on the full resolution frame.
+// The band around the line is copied into a strip, one row per step along the major axis,
+// so the line runs nearly straight down the strip. Canny and a small Hough over offset and
+// slope run on the strip only, the locality test runs on the winner, and the pixels of its
+// local runs are fitted by least squares for a sub-pixel line.
+bool LineFinder::refineLine(const Line& coarse, PyramidStrip& strip, Line& line) {
+    const cv::Mat& frame = _frame;
+    double sx = frame.cols / (double)_worksheet.cols;
+    double sy = frame.rows / (double)_worksheet.rows;
+    
+    // Same line in frame coordinates. Pixel centers map as x' = (x + 0.5) * sx - 0.5.
+    double tcos = cos(coarse[1]);
+    double tsin = sin(coarse[1]);
+    double nx = tcos / sx;
+    double ny = tsin / sy;
+    double norm = hypot(nx, ny);
+    double fcos = nx / norm;
+    double fsin = ny / norm;
+    double frho = (coarse[0] + 0.5 * (tcos + tsin) - 0.5 * (nx + ny)) / norm;
+    
+    // Line direction is (-sin, cos), so y is the major axis when |cos| >= |sin|
+    bool alongY = fabs(fcos) >= fabs(fsin);
+    int length = alongY ? frame.rows : frame.cols;
+    int minorLength = alongY ? frame.cols : frame.rows;
+    
+    // The coarse line may be off by a worksheet pixel or two in rho, and a bin or two in theta
+    double scale = MAX(sx, sy);
+    auto slopeRangeOf = [&](int steps) {
+        return cvCeil(0.5 * steps * tan(2.0 * CV_PI / params.houghResolutionTheta));
+    };
+    int slopeRange = slopeRangeOf(length);
+    int band = cvCeil(2.0 * scale * params.houghResolutionRho) + slopeRange;
+    int width = 2 * band + 1;
+    
+    // Strips of both orientations are views of buffers sized for the longer axis,
+    // so the buffers keep their memory from line to line and from frame to frame
+    int maxLength = MAX(frame.rows, frame.cols);
+    int maxWidth = width + 2 * (slopeRangeOf(maxLength) - slopeRange);
+    strip.color.create(maxLength, maxWidth, frame.type());
+    strip.gray.create(maxLength, maxWidth, CV_8UC1);
+    strip.edges.create(maxLength, maxWidth, CV_8UC1);
+    cv::Range rows(0, length);
+    cv::Range cols(0, width);
+    cv::Mat color = strip.color(rows, cols);
+    cv::Mat gray = strip.gray(rows, cols);
+    cv::Mat edges = strip.edges(rows, cols);
+    
+    // Straighten the band, replicating the border of the frame
+    strip.origins.resize(length);
+    size_t pixelSize = frame.elemSize();
+    for (int t = 0; t < length; t++) {
+        double center = alongY ? (frho - t * fsin) / fcos : (frho - t * fcos) / fsin;
+        int origin = cvRound(center) - band;
+        strip.origins[t] = origin;
+        uchar* dst = color.ptr<uchar>(t);
+        for (int j = 0; j < width; j++) {
+            int m = MIN(MAX(origin + j, 0), minorLength - 1);
+            const uchar* src = alongY ? frame.ptr<uchar>(t) + m * pixelSize : frame.ptr<uchar>(m) + t * pixelSize;
+            memcpy(dst + j * pixelSize, src, pixelSize);
+        }
     }
     
-    return *_result;
+    convertToGray(color, gray);
+    // Bilateral filtering is too slow for every strip, so smooth with a Gaussian instead
+    cv::GaussianBlur(gray, gray, cv::Size(5, 5), 0);
+    cv::Canny(gray, edges, params.cannyThreshold1, params.cannyThreshold2, params.cannyAperture, params.cannyUseL2Gradient);
+    
+    // Lines in the strip are j = j0 + k * (t - middle) / middle, for offset j0 and slope k
+    double middle = 0.5 * length;
+    int slopes = 2 * slopeRange + 1;
+    strip.votes.assign(slopes * width, 0);
+    for (int t = 0; t < length; t++) {
+        const uchar* edgeRow = edges.ptr<uchar>(t);
+        double step = (t - middle) / middle;
+        for (int j = 0; j < width; j++) {
+            if (edgeRow[j] == 0) {
+                continue;
+            }
+            for (int k = -slopeRange; k <= slopeRange; k++) {
+                int j0 = cvRound(j - k * step);
+                if (j0 >= 0 && j0 < width) {
+                    ++strip.votes[(k + slopeRange) * width + j0];
+                }
+            }
+        }
+    }
+    int best = int(std::max_element(strip.votes.begin(), strip.votes.end()) - strip.votes.begin());
+    double bestSlope = best / width - slopeRange;
+    double bestOffset = best % width;
+    
+    // Locality test along the winner, with the threshold scaled to the frame
+    int threshold = cvRound(params.houghLocalThreshold() * scale);
+    strip.accepted.assign(length, 0);
+    strip.points.clear();
+    strip.pointRows.clear();
+    int score = 0;
+    int runStart = 0;
+    for (int t = 0; t <= length; t++) {
+        bool isPointLine = false;
+        if (t < length) {
+            double j = bestOffset + bestSlope * (t - middle) / middle;
+            const uchar* edgeRow = edges.ptr<uchar>(t);
+            for (int dj = cvFloor(j) - 1; dj <= cvCeil(j) + 1; dj++) {
+                if (dj < 0 || dj >= width || edgeRow[dj] == 0 || fabs(dj - j) > 1.0) {
+                    continue;
+                }
+                int m = strip.origins[t] + dj;
+                if (m < 0 || m >= minorLength) {
+                    continue;
+                }
+                isPointLine = true;
+                strip.points.push_back(alongY ? cv::Point2f(m, t) : cv::Point2f(t, m));
+                strip.pointRows.push_back(t);
+            }
+        }
+        if (isPointLine) {
+            continue;
+        }
+        // The run [runStart, t) ended
+        if (t - runStart > threshold) {
+            score += t - runStart;
+            std::fill(strip.accepted.begin() + runStart, strip.accepted.begin() + t, 1);
+        }
+        runStart = t + 1;
+    }
+    if (score <= threshold) {
+        return false;
+    }
+    
+    // Fit the pixels of the local runs only
+    size_t kept = 0;
+    for (size_t i = 0; i < strip.points.size(); i++) {
+        if (strip.accepted[strip.pointRows[i]]) {
+            strip.points[kept++] = strip.points[i];
+        }
+    }
+    strip.points.resize(kept);
+    cv::Vec4f fit;
+    cv::fitLine(strip.points, fit, cv::DIST_L2, 0, 0.01, 0.01);
+    
+    // Direction (vx, vy) is (-sin, cos) up to its sign. Keep theta in [0, pi).
+    double theta = atan2(-fit[0], fit[1]);
+    if (theta < 0) {
+        theta += CV_PI;
+    }
+    if (theta >= CV_PI) {
+        theta -= CV_PI;
+    }
+    line[0] = fit[2] * cos(theta) + fit[3] * sin(theta);
+    line[1] = theta;
+    line[2] = score;
+    return true;
 }
 
+void LineFinder::detectTrackedLocalHough(std::vector<Line>& lines) {
+    FH_PROFILE_SCOPE("Tracked Local Hough");
+    
+    bool rescan = _tracked.empty() || _framesSinceScan >= params.trackingRescanInterval;
+    if (!rescan) {
+        // A lost line may have moved further than the window, or new lines may have appeared.
+        // Tracked lines which converged to the same line are merged, not lost.
+        rescan = trackLines(lines) > 0;
+    }
+    if (rescan) {
+        detectStandardLocalHough(lines);
+        _framesSinceScan = 0;
+    } else {
+        ++_framesSinceScan;
+    }
+    _tracked.assign(lines.begin(), lines.end());
+}
+
+void LineFinder::resetTracking() {
+    _tracked.clear();
+    _framesSinceScan = 0;
+}
 
+// Each tracked line moves to the best line of its (rho, theta) window,
+// so the cost depends on the number of tracked lines only.
+int LineFinder::trackLines(std::vector<Line>& lines) {
+    auto& trigs = _trigs;
+    const int thetaCount = (int)trigs.size();
+    const int windowRho = MAX(params.trackingWindowRho, 0);
+    const int windowTheta = MIN(MAX(params.trackingWindowTheta, 0), thetaCount / 2);
+    int threshold = params.houghLocalThreshold();
+    
+    lines.clear();
+    int lost = 0;
+    FH_COUNT(CandidateLines, _tracked.size() * (2 * windowRho + 1) * (2 * windowTheta + 1));
+    for (auto& tracked: _tracked) {
+        int center = cvRound(tracked[1] * params.houghResolutionTheta / CV_PI);
+        Line best(0, 0, 0);
+        for (int dt = -windowTheta; dt <= windowTheta; dt++) {
+            // (rho, theta) and (-rho, theta - pi) are the same line
+            int t = center + dt;
+            float sign = 1.0f;
+            if (t < 0) {
+                t += thetaCount;
+                sign = -1.0f;
+            } else if (t >= thetaCount) {
+                t -= thetaCount;
+                sign = -1.0f;
+            }
+            
+            for (int dr = -windowRho; dr <= windowRho; dr++) {
+                float rho = sign * tracked[0] + dr * params.houghResolutionRho;
+                Line line;
+                if (testLocality(t, rho, line, threshold) && line[2] > best[2]) {
+                    best = line;
+                }
+            }
+        }
+        if (best[2] == 0) {
+            ++lost;
+            continue;
+        }
+        // Two tracked lines may have converged to the same line
+        bool isDuplicate = false;
+        for (auto& line: lines) {
+            if (line[0] == best[0] && line[1] == best[1]) {
+                isDuplicate = true;
+                break;
+            }
+        }
+        if (!isDuplicate) {
+            lines.push_back(best);
+        }
+    }
+    return lost;
+}
 
 bool LineFinder::isFindingMeaningful(cv::Size& imageSize, float rho, cv::Vec3f& theta, float diagonalAngle) {
     float t = theta[0];
@@ -185,119 +1070,441 @@ bool LineFinder::isFindingMeaningful(cv::Size& imageSize, float rho, cv::Vec3f&
     return rho >= imageSize.width * tcos;
 }
 
-bool LineFinder::didFindLine(cv::Mat* image, float rho, Angle& theta, Line& line, int& threshold) {
+// Walks along y read the transposed mask when there is one. Spans are rows of the layout
+// only when the walk's minor axis is y there, i.e. for walks along x or transposed walks.
+LineFinder::WalkLayout LineFinder::layoutOf(const LineWalk& walk) const {
+    bool isTransposed = walk.alongY && !_nearEdgeT.empty();
+    bool hasRows = !walk.spanEnds.empty() && (!walk.alongY || isTransposed);
+    
+    WalkLayout layout;
+    layout.mask = isTransposed ? &_nearEdgeT : &_nearEdge;
+    layout.bits = hasRows ? (isTransposed ? &_nearEdgeBitsT : &_nearEdgeBits) : nullptr;
+    layout.offsets = isTransposed ? walk.transposedOffsets.data() : walk.offsets.data();
+    layout.minorStride = (walk.alongY && !isTransposed) ? 1 : layout.mask->cols;
+    return layout;
+}
+
+bool LineFinder::didFindLine(const LineWalk& walk, float rho, const Angle& theta, Line& line, int threshold, std::vector<Segment>* segments) const {
     double tcos = theta[1];
     double tsin = theta[2];
     
-    int multiplier = MAX(image->rows, image->cols);
-    cv::Point2f center(rho * tcos, rho * tsin);
-    
-    cv::Point pt0(cvRound(center.x - multiplier * tsin), cvRound(center.y + multiplier * tcos));
-    cv::Point pt1(cvRound(center.x + multiplier * tsin), cvRound(center.y - multiplier * tcos));
-    
     line[0] = rho;
     line[1] = theta[0];
-    line[2] = 0;
+    
+    // Where the line enters the major axis, i.e. x at y = 0 or y at x = 0.
+    // Rounded on its own, so the walk is within a pixel of the line rather than half a pixel.
+    int base = cvRound(walk.alongY ? rho / tcos : rho / tsin);
+    return didFindLineFrom(walk, base, line, threshold, segments);
+}
 
-    cv::LineIterator iterator(*image, pt0, pt1);
+bool LineFinder::didFindLineFrom(const LineWalk& walk, int base, Line& line, int threshold, std::vector<Segment>* segments) const {
+    line[2] = 0;
+    int begin = 0;
+    int end = 0;
+    walk.clip(base, begin, end);
     
-    if (iterator.count <= threshold) {
+    if (end - begin <= threshold) {
         return false;
     }
+    FH_COUNT(WalkedPixels, end - begin);
     
-    int votes = 0;
-    for (int i = 0; i < iterator.count; i++, ++iterator) {
-        cv::Point pos = iterator.pos();
-        bool isPointLine = (*iterator.ptr != 0) || isLine(image, pos);
-
-        if (isPointLine) {
-            // Accumulate votes
-            ++votes;
+    // Pixel at a step of the walk, in worksheet coordinates
+    auto pointAt = [&](int step) {
+        int m = base + walk.minor[step];
+        return walk.alongY ? cv::Point2f(m, step) : cv::Point2f(step, m);
+    };
+    size_t firstSegment = segments ? segments->size() : 0;
+    int lastEnd = 0;
+    auto addSegment = [&](int runBegin, int runEnd, int votes) {
+        if (segments->size() > firstSegment && runBegin - lastEnd <= params.segmentGap) {
+            segments->back().end = pointAt(runEnd - 1);
+            segments->back().line[2] += votes;
         } else {
-            // If votes are bigger than threshold
-            // Append to line candidate's votes
-            // Else
-            // Discard
-            if (votes > threshold) {
-                line[2] += votes;
+            Segment segment;
+            segment.line = Line(line[0], line[1], votes);
+            segment.begin = pointAt(runBegin);
+            segment.end = pointAt(runEnd - 1);
+            segments->push_back(segment);
+        }
+        lastEnd = runEnd;
+    };
+    
+    int votes = 0;
+#ifdef FH_PROFILE
+    int runs = 0;
+#endif
+    // runEnd is the step after the last pixel of the run
+    auto closeRun = [&](int runEnd) {
+        // If votes are bigger than threshold
+        // Append to line candidate's votes
+        // Else
+        // Discard
+        if (votes > threshold) {
+            line[2] += votes;
+#ifdef FH_PROFILE
+            ++runs;
+#endif
+            if (segments) {
+                addSegment(runEnd - votes, runEnd, votes);
+            }
+        }
+        votes = 0;
+    };
+    
+    WalkLayout layout = layoutOf(walk);
+    if (layout.bits) {
+        // Each span is a piece of one row of the layout, read up to 64 pixels at a time.
+        // Runs of ones are added at once, and runs of zeros are skipped at once.
+        const int* minor = walk.minor.data();
+        size_t span = std::upper_bound(walk.spanEnds.begin(), walk.spanEnds.end(), begin) - walk.spanEnds.begin();
+        for (int x = begin; x < end; span++) {
+            int spanEnd = MIN(walk.spanEnds[span], end);
+            const uint64_t* row = layout.bits->row(base + minor[x]);
+            while (x < spanEnd) {
+                int shift = x & 63;
+                int count = MIN(64 - shift, spanEnd - x);
+                uint64_t word = row[x >> 6] >> shift;
+                if (count < 64) {
+                    word &= (uint64_t(1) << count) - 1;
+                }
+                
+                // Ones at the start of the word
+                int ones = ~word == 0 ? 64 : countTrailingZeros(~word);
+                ones = MIN(ones, count);
+                votes += ones;
+                if (ones == count) {
+                    x += count;
+                    continue;
+                }
+                closeRun(x + ones);
+                
+                // Zeros after them
+                uint64_t rest = word >> ones;
+                int zeros = rest == 0 ? count - ones : MIN(countTrailingZeros(rest), count - ones);
+                x += ones + zeros;
+            }
+        }
+    } else {
+        const uchar* data = layout.mask->data;
+        const long origin = long(base) * layout.minorStride;
+        const int* offsets = layout.offsets;
+        
+        for (int i = begin; i < end; i++) {
+            bool isPointLine = data[origin + offsets[i]] != 0;
+            
+            if (isPointLine) {
+                // Accumulate votes
+                ++votes;
+            } else {
+                closeRun(i);
             }
-            votes = 0;
         }
     }
+    // The last run may reach the border of the image
+    if (params.countBorderRuns) {
+        closeRun(end);
+    }
+    FH_COUNT(AcceptedRuns, runs);
     return line[2] > threshold;
 }
 
 
 
-bool LineFinder::isLine(cv::Mat* image, cv::Point& p) {
-    if (p.x <= 0 || p.x >= image->cols - 1) {
-        return false;
+bool LineFinder::testLocality(int thetaIdx, float rho, Line& line, int threshold) {
+    if (!_runLengths.empty()) {
+        return didFindLineByRuns(thetaIdx, rho, line, threshold);
     }
+    return didFindLine(_walks->walk(thetaIdx), rho, _trigs[thetaIdx], line, threshold);
+}
+
+void LineFinder::testLocalityLockstep(int thetaIdx, const float* rhos, const int* bases, int count, int threshold, std::vector<Line>& lines) const {
+    const LineWalk& walk = _walks->walk(thetaIdx);
+    const Angle& theta = _trigs[thetaIdx];
+    WalkLayout layout = layoutOf(walk);
     
-    if (p.y <= 0 || p.y >= image->rows - 1) {
-        return false;
-    }
-    uchar* data = nullptr;
-    data = &image->data[(p.y - 1) * image->cols + (p.x - 1)];
-    for (int i = 0; i < 3; i++) {
-        if (data[i] != 0) {
-            return true;
+    float laneRhos[lockstepLanes];
+    int origins[lockstepLanes];
+    int begins[lockstepLanes];
+    int ends[lockstepLanes];
+    int lanes = 0;
+    for (int k = 0; k < MIN(count, lockstepLanes); k++) {
+        // Same clipping as didFindLine()
+        int begin = 0;
+        int end = 0;
+        walk.clip(bases[k], begin, end);
+        if (end - begin <= threshold) {
+            continue;
         }
+        FH_COUNT(WalkedPixels, end - begin);
+        
+        laneRhos[lanes] = rhos[k];
+        origins[lanes] = bases[k] * layout.minorStride;
+        begins[lanes] = begin;
+        ends[lanes] = end;
+        ++lanes;
+    }
+    if (lanes == 0) {
+        return;
     }
     
-    data = &image->data[p.y * image->cols + (p.x - 1)];
-    for (int i = 0; i < 3; i++) {
-        if (data[i] != 0) {
-            return true;
+    int scores[lockstepLanes];
+    int runs[lockstepLanes];
+    walkLockstep(simdLevel(), *layout.mask, layout.offsets, lanes, origins, begins, ends, threshold, params.countBorderRuns, scores, runs);
+    for (int k = 0; k < lanes; k++) {
+        FH_COUNT(AcceptedRuns, runs[k]);
+        if (scores[k] > threshold) {
+            lines.push_back(Line(laneRhos[k], theta[0], scores[k]));
         }
     }
+}
+
+// Same test as didFindLine(), walking backwards one run at a time instead of one pixel at a time.
+// The run ending at a pixel is looked up in the direction nearest to the line.
+bool LineFinder::didFindLineByRuns(int thetaIdx, float rho, Line& line, int threshold) const {
+    const LineWalk& walk = _walks->walk(thetaIdx);
+    const Angle& theta = _trigs[thetaIdx];
+    line[0] = rho;
+    line[1] = theta[0];
+    line[2] = 0;
     
-    data = &image->data[(p.y + 1) * image->cols + (p.x - 1)];
-    for (int i = 0; i < 3; i++) {
-        if (data[i] != 0) {
-            return true;
+    double tcos = theta[1];
+    double tsin = theta[2];
+    int base = cvRound(walk.alongY ? rho / tcos : rho / tsin);
+    int begin = 0;
+    int end = 0;
+    walk.clip(base, begin, end);
+    if (end - begin <= threshold) {
+        return false;
+    }
+    
+    int thetaCount = (int)_trigs.size();
+    int directions = (int)(_runLengths.size() / _nearEdge.total());
+    int direction = cvRound(thetaIdx * directions / (double)thetaCount) % directions;
+    const int16_t* runs = _runLengths.data() + direction * _nearEdge.total();
+    const long origin = walk.alongY ? base : long(base) * _nearEdge.cols;
+    const int* offsets = walk.offsets.data();
+    
+#ifdef FH_PROFILE
+    int accepted = 0;
+#endif
+    for (int i = end - 1; i >= begin;) {
+        int run = runs[origin + offsets[i]];
+        if (run > 0) {
+            // The run may have started before the line entered the image
+            int votes = MIN(run, i - begin + 1);
+            // The first run met reaches the border if it ends at the last step
+            bool isCounted = i < end - 1 || params.countBorderRuns;
+            if (isCounted && votes > threshold) {
+                line[2] += votes;
+#ifdef FH_PROFILE
+                ++accepted;
+#endif
+            }
+            i -= run;
+        } else {
+            i += run;
         }
     }
+    FH_COUNT(AcceptedRuns, accepted);
+    return line[2] > threshold;
+}
+
+// Every pixel continues the run of the pixel one step before it, along the walk of each direction
+void LineFinder::buildRunLengths() {
+    int directions = MIN(params.runLengthDirections, params.houghResolutionTheta);
+    if (directions <= 0) {
+        _runLengths.clear();
+        return;
+    }
     
-    return false;
+    const int rows = _nearEdge.rows;
+    const int cols = _nearEdge.cols;
+    const size_t plane = _nearEdge.total();
+    const int thetaCount = (int)_trigs.size();
+    _runLengths.resize(directions * plane);
+    
+    pool().run(directions, [&](int direction) {
+        const LineWalk& walk = _walks->walk(direction * thetaCount / directions);
+        int16_t* runs = _runLengths.data() + direction * plane;
+        
+        auto extend = [&](int16_t previous, bool isLine) -> int16_t {
+            if (isLine) {
+                return previous > 0 ? (int16_t)MIN(previous + 1, INT16_MAX) : 1;
+            }
+            return previous < 0 ? (int16_t)MAX(previous - 1, -INT16_MAX) : -1;
+        };
+        
+        if (walk.alongY) {
+            for (int y = 0; y < rows; y++) {
+                const uchar* mask = _nearEdge.ptr<uchar>(y);
+                int shift = y > 0 ? walk.minor[y] - walk.minor[y - 1] : 0;
+                for (int x = 0; x < cols; x++) {
+                    int px = x - shift;
+                    int16_t previous = (y > 0 && px >= 0 && px < cols) ? runs[(y - 1) * cols + px] : 0;
+                    runs[y * cols + x] = extend(previous, mask[x] != 0);
+                }
+            }
+        } else {
+            for (int x = 0; x < cols; x++) {
+                int shift = x > 0 ? walk.minor[x] - walk.minor[x - 1] : 0;
+                for (int y = 0; y < rows; y++) {
+                    int py = y - shift;
+                    int16_t previous = (x > 0 && py >= 0 && py < rows) ? runs[py * cols + x - 1] : 0;
+                    runs[y * cols + x] = extend(previous, _nearEdge.data[y * cols + x] != 0);
+                }
+            }
+        }
+    });
+}
+
+size_t LineFinder::runLengthMemory() {
+    return _runLengths.size() * sizeof(int16_t);
 }
 
-void LineFinder::preprocess(cv::Mat* rawImage) {
-    Timer timer("Preprocess");
-    cv::Size size = getProcessingSize(*rawImage, params.worksheetLength);
-    int channel = rawImage->dims;
+// A pixel is on a line if it is an edge, or if any of its 8 neighbours is an edge.
+// Pixels on the border are on a line only if they are edges themselves.
+// This used to be tested pixel by pixel during the walk; building it at once costs one pass.
+void LineFinder::buildNearEdgeMask(const cv::Mat& edges, cv::Mat& mask) {
+    // cv::dilate runs on OpenCV's universal intrinsics(SSE/AVX2 on x86, NEON on ARM),
+    // and falls back to scalar code on other targets.
+    cv::dilate(edges, mask, cv::Mat());
     
-    // Resize
-    cv::Mat* resized = new cv::Mat(size, rawImage->type());
-    cv::resize(*rawImage, *resized, size);
-    // Bilateral or Gaussian
-    // It's just a matter of choice, I think,
-    // but Bilateral Filtering was much better for extracting lines, in average.
-    // Instead, it might be(and most of the case, yes) slower than smoothing images using Gaussian Filtering.
-    cv::Mat* bilateral = new cv::Mat(resized->size(), resized->type());
-    cv::bilateralFilter(*resized, *bilateral, params.bilateralSpaceS, params.bilateralColorS, params.bilateralSpaceS);
-//    cv::GaussianBlur(*resized, *bilateral, cv::Size(7, 7), params.bilateralColorS);
-    resized->release();
-    // Grayscale
+    edges.row(0).copyTo(mask.row(0));
+    edges.row(edges.rows - 1).copyTo(mask.row(edges.rows - 1));
+    edges.col(0).copyTo(mask.col(0));
+    edges.col(edges.cols - 1).copyTo(mask.col(edges.cols - 1));
+}
+
+void LineFinder::convertToGray(const cv::Mat& image, cv::Mat& gray) {
+    switch (image.channels()) {
+        case 1:
+            image.copyTo(gray);
+            break;
+        case 3:
+            cv::cvtColor(image, gray, cv::COLOR_BGR2GRAY);
+            break;
+        default:
+            cv::cvtColor(image, gray, cv::COLOR_BGRA2GRAY);
+            break;
+    }
+}
+
+void LineFinder::preprocess(const cv::Mat& rawImage) {
+    FH_PROFILE_SCOPE("Preprocess");
+    cv::Size size = getProcessingSize(rawImage, params.worksheetLength);
+    auto& times = _preprocessTimes;
+    auto lap = std::chrono::steady_clock::now();
+    auto elapsed = [&lap]() {
+        auto now = std::chrono::steady_clock::now();
+        double ms = std::chrono::duration<double, std::milli>(now - lap).count();
+        lap = now;
+        return ms;
+    };
     
-    cv::Mat* grayImage = new cv::Mat(size, CV_8UC1);
-    if (channel == 3) {
-        cv::cvtColor(*bilateral, *grayImage, cv::COLOR_BGR2GRAY);
+    // Every stage writes into its own buffer, which keeps its memory between frames
+    if (params.grayFirst) {
+        // Grayscale. Single channel frames are read in place.
+        const cv::Mat* gray = &rawImage;
+        if (rawImage.channels() != 1) {
+            convertToGray(rawImage, _fullGray);
+            gray = &_fullGray;
+        }
+        times.gray = elapsed();
+        FH_PROFILE_RECORD("Gray", times.gray);
+        // Resize, averaging the pixels of each area
+        cv::resize(*gray, _resized, size, 0, 0, cv::INTER_AREA);
+        times.resize = elapsed();
+        FH_PROFILE_RECORD("Resize", times.resize);
+        // Smooth
+        smooth(_resized, _gray);
+        times.smooth = elapsed();
+        FH_PROFILE_RECORD("Smooth", times.smooth);
     } else {
-        cv::cvtColor(*bilateral, *grayImage, cv::COLOR_BGRA2GRAY);
+        // Resize
+        cv::resize(rawImage, _resized, size);
+        times.resize = elapsed();
+        FH_PROFILE_RECORD("Resize", times.resize);
+        // Smooth
+        smooth(_resized, _smoothed);
+        times.smooth = elapsed();
+        FH_PROFILE_RECORD("Smooth", times.smooth);
+        // Grayscale
+        convertToGray(_smoothed, _gray);
+        times.gray = elapsed();
+        FH_PROFILE_RECORD("Gray", times.gray);
     }
-    bilateral->release();
+    
+    // Gradients of this frame are computed by voteGradient() when it needs them
+    _hasGradient = false;
     
     // Canny edge
-    cv::Mat* edgeImage = new cv::Mat(size, resized->type());
-    cv::Canny(*grayImage, *edgeImage, params.cannyThreshold1, params.cannyThreshold2, params.cannyAperture, params.cannyUseL2Gradient);
+    cv::Canny(_gray, _worksheet, params.cannyThreshold1, params.cannyThreshold2, params.cannyAperture, params.cannyUseL2Gradient);
+    times.canny = elapsed();
+    FH_PROFILE_RECORD("Canny", times.canny);
+    
+    // Mask of pixels which the locality test counts as a line
+    buildNearEdgeMask(_worksheet, _nearEdge);
+    packBits(_nearEdge, _nearEdgeBits);
+    times.nearEdge = elapsed();
+    FH_PROFILE_RECORD("Near Edge", times.nearEdge);
+    
+    buildRunLengths();
+    times.runLengths = elapsed();
+    FH_PROFILE_RECORD("Run Lengths", times.runLengths);
     
-    _worksheet = edgeImage;
-    timer.stop();
+    if (params.transposedWalks) {
+        cv::transpose(_nearEdge, _nearEdgeT);
+        packBits(_nearEdgeT, _nearEdgeBitsT);
+    } else {
+        _nearEdgeT.release();
+    }
+    times.transpose = elapsed();
+    FH_PROFILE_RECORD("Transpose", times.transpose);
+}
+
+void LineFinder::smooth(const cv::Mat& image, cv::Mat& smoothed) {
+    int kernel = params.smoothingKernel | 1;
+    switch (params.smoothing) {
+        case Smoothing::Bilateral:
+            // Bilateral or Gaussian
+            // It's just a matter of choice, I think,
+            // but Bilateral Filtering was much better for extracting lines, in average.
+            // Instead, it might be(and most of the case, yes) slower than smoothing images using Gaussian Filtering.
+            cv::bilateralFilter(image, smoothed, params.bilateralSpaceS, params.bilateralColorS, params.bilateralSpaceS);
+            break;
+        case Smoothing::Median:
+            cv::medianBlur(image, smoothed, kernel);
+            break;
+        case Smoothing::Gaussian:
+            cv::GaussianBlur(image, smoothed, cv::Size(kernel, kernel), 0);
+            break;
+        case Smoothing::None:
+            image.copyTo(smoothed);
+            break;
+    }
+}
+
+WorkerPool& LineFinder::pool() {
+    if (!_pool) {
+        _pool.reset(new WorkerPool(params.threadCount()));
+    }
+    return *_pool;
 }
 
 cv::Mat& LineFinder::preprocessedImage() {
-    return *_worksheet;
+    return _worksheet;
+}
+
+const PreprocessTimes& LineFinder::preprocessTimes() {
+    return _preprocessTimes;
+}
+
+const std::vector<Line>& LineFinder::lines() {
+    return _lines;
+}
+
+const std::vector<Segment>& LineFinder::segments() {
+    return _segments;
 }
 
 void LineFinder::prepareCosSin(std::vector<Angle>& table) {
@@ -9,13 +9,49 @@
 #ifndef FasterHough_hpp
 #define FasterHough_hpp
 
+#include <string>
 #include <vector>
+#include <climits>
+#include <thread>
+#include <memory>
+#include <chrono>
 #include <opencv2/core.hpp>
+#include "LineWalkCache.hpp"
+#include "LockstepWalker.hpp"
+#include "Helper.hpp"
 
 namespace fh {
     typedef cv::Vec3f Line; // rho, theta, votes
     typedef cv::Vec3f Angle; // theta, cos, sin
     
+    // Part of a line, from begin to end. line[2] holds the votes behind it.
+    struct Segment {
+        Line line;
+        cv::Point2f begin;
+        cv::Point2f end;
+    };
+    
+    enum class HoughMode {
+        Standard,
+        StandardLocal,
+        NaiveLocal,
+        FusedLocal,
+        GradientLocal,
+        PyramidLocal,   // Lines are in the coordinates of the input image
+    };
+    
+    // Parses "std", "local", "naive", "fused", "gradient" or "pyramid". Returns false for anything else.
+    bool parseHoughMode(const std::string& name, HoughMode& mode);
+    
+    
+    enum class Smoothing {
+        Bilateral,  // Edge preserving, and the slowest
+        Median,     // Edge preserving, much cheaper on a single channel
+        Gaussian,
+        None,       // Only the averaging of the resize
+    };
+    
+    
     class LineParams {
     public:
         int worksheetLength = 300;
@@ -23,6 +59,13 @@ namespace fh {
         int bilateralColorS = 200;
         int bilateralSpaceS = 7;
         
+        Smoothing smoothing = Smoothing::Bilateral;
+        // Kernel size of the median and Gaussian smoothing
+        int smoothingKernel = 5;
+        // Converts to gray before resizing and smoothing, so both run on one channel
+        // instead of three. Resizing also averages pixels, which takes some of the smoothing.
+        bool grayFirst = false;
+        
         int cannyAperture = 5;
         int cannyThreshold1 = 100;
         int cannyThreshold2 = 200;
@@ -31,41 +74,287 @@ namespace fh {
         int houghResolutionTheta = 360;
         int houghResolutionRho = 1;
         
+        // Candidates of the global vote within this many rho and theta bins of a more voted one
+        // are dropped before the locality test. 0 in either tests every candidate, like before.
+        // 2 and 2 leave one candidate per line on the images in images/.
+        int candidateMergeRho = 0;
+        int candidateMergeTheta = 0;
+        
+        // runGradientLocalHough() votes for thetas within this many bins of each pixel's gradient
+        int gradientWindowTheta = 8;
+        
+        // detectTrackedLocalHough() searches this many bins around each tracked line,
+        // and scans the whole image at least once in this many frames
+        int trackingWindowRho = 2;
+        int trackingWindowTheta = 2;
+        int trackingRescanInterval = 30;
+        
+        // Directions of the run-length transform used by the locality test. 0 walks pixel by pixel.
+        // Each direction keeps the signed length of the run ending at every pixel, so a walk
+        // jumps from run to run. houghResolutionTheta directions give the same lines as walking,
+        // fewer directions take less memory and approximate each line by the nearest direction.
+        int runLengthDirections = 0;
+        
+        // runNaiveLocalHough() walks lines of the same angle lockstepLanes at a time with the widest
+        // vector instructions of the CPU. Gives the same lines as walking them one by one.
+        bool lockstepWalk = true;
+        
+        // runNaiveLocalHough() uses scans compiled for 180 or 360 theta bins and 1 or 2 pixel rho bins,
+        // with angle tables built at compile time and entry points stepped in fixed point.
+        // Other resolutions, or false, take the generic scan.
+        bool specializedKernels = true;
+        
+        // Keeps a transposed copy of the near-edge mask, so walks of near-vertical lines
+        // move along its rows instead of jumping a row of the worksheet at every step
+        bool transposedWalks = false;
+        
+        // detectLocalSegments() merges runs of a line which are at most this many pixels apart
+        int segmentGap = 2;
+        
+        // Counts the run of a line reaching the border of the worksheet too. The original walk drops it,
+        // so this is off by default. TiledLineFinder turns it on, since tile borders cut runs in two.
+        bool countBorderRuns = false;
+        
+        // Worker threads for runNaiveLocalHough(). 0 uses every core.
+        int threads = 0;
+        
+        // Votes a line needs to pass the global vote and the locality test.
+        // 0 takes a third and a quarter of worksheetLength.
+        int globalThreshold = 0;
+        int localThreshold = 0;
+        
         inline int houghThreshold() {
-            return int(worksheetLength / 3);
+            return globalThreshold > 0 ? globalThreshold : int(worksheetLength / 3);
         }
         
         inline int houghLocalThreshold() {
-            return int(worksheetLength / 4);
+            return localThreshold > 0 ? localThreshold : int(worksheetLength / 4);
+        }
+        
+        inline int threadCount() {
+            if (threads > 0) {
+                return threads;
+            }
+            return MAX(1, (int)std::thread::hardware_concurrency());
         }
     };
     
     
+    // Time spent by each stage of the last process() call, in milliseconds
+    struct PreprocessTimes {
+        double resize = 0.0;
+        double smooth = 0.0;
+        double gray = 0.0;
+        double canny = 0.0;
+        double nearEdge = 0.0;
+        double runLengths = 0.0;
+        double transpose = 0.0;
+    };
+    
+    
     class LineFinder {
-        cv::Mat* _worksheet = nullptr;
-        cv::Mat* _result = nullptr;
+        // Per frame buffers, allocated on the first frame and reused afterwards
+        cv::Mat _fullGray;
+        cv::Mat _resized;
+        cv::Mat _smoothed;
+        cv::Mat _gray;
+        cv::Mat _worksheet;
+        cv::Mat _nearEdge;
+        BitMap _nearEdgeBits;
+        // Transposed near-edge mask, kept if LineParams::transposedWalks is set
+        cv::Mat _nearEdgeT;
+        BitMap _nearEdgeBitsT;
+        // [direction][y][x] lengths of the runs ending at each pixel along each direction.
+        // Positive for runs of line pixels, negative for runs of other pixels.
+        std::vector<int16_t> _runLengths;
+        std::shared_ptr<const LineWalkCache> _walks;
+        std::vector<Angle> _trigs;
+        std::vector<float> _rhos;
+        std::vector<Line> _candidates;
+        // Accumulator of detectCandidates() and voteFused(), laid out like the one of cv::HoughLines
+        std::vector<int> _houghVotes;
+        std::vector<float> _houghSin;
+        std::vector<float> _houghCos;
+        std::vector<int> _houghPeaks;
+        // Buffers of suppressCandidates(), an open addressing hash table of cells cleared every frame.
+        // Kept candidates of each cell form a list starting at the cell's head and linked by next.
+        std::vector<int64_t> _candidateCells;
+        std::vector<int> _candidateHeads;
+        std::vector<int> _candidateNext;
+        std::vector<Line> _lines;
+        std::vector<Segment> _segments;
+        std::vector<std::vector<Line>> _buffers;
+        
+        // Buffers of voteFused(). Cells are the walks of didFindLine(), indexed by theta and entry point.
+        struct FusedCell {
+            int last = INT_MIN; // Step of the last pixel in the current run
+            int run = 0;        // Length of the current run
+            int score = 0;      // Sum of the closed runs longer than the local threshold
+        };
+        struct FusedPixel {
+            int x;
+            int y;
+            bool isEdge;
+        };
+        std::vector<FusedPixel> _fusedByRow;
+        std::vector<FusedPixel> _fusedByCol;
+        std::vector<int> _fusedVerticals;
+        std::vector<int> _fusedHorizontals;
+        std::vector<FusedCell> _fusedCells;
+        std::vector<int> _fusedBaseOffsets;
+        
+        // Buffers of voteGradient(). Gradients are computed once a frame, on the first use.
+        cv::Mat _dx;
+        cv::Mat _dy;
+        bool _hasGradient = false;
+        std::vector<int> _gradientVotes;
+        std::vector<int> _gradientPeaks;
+        
+        // Buffers of detectPyramidLocalHough(). A strip is the band around one coarse line
+        // at full resolution, straightened so that the line runs along its rows.
+        struct PyramidStrip {
+            cv::Mat color;
+            cv::Mat gray;
+            cv::Mat edges;
+            std::vector<int> origins;       // Minor axis position of column 0 at each row
+            std::vector<int> votes;         // [slope][column] votes of the strip Hough
+            std::vector<uchar> accepted;    // Rows in runs longer than the local threshold
+            std::vector<cv::Point2f> points;
+            std::vector<int> pointRows;
+        };
+        // Lines followed by detectTrackedLocalHough() from frame to frame
+        std::vector<Line> _tracked;
+        int _framesSinceScan = 0;
+        
+        cv::Mat _frame; // Frame given to the last process()
+        std::vector<Line> _coarseLines;
+        std::vector<PyramidStrip> _strips;
+        std::vector<Line> _refined;
+        std::vector<uchar> _refinedFound;
         
         LineParams params;
+        // Threads of the parallel stages, started on their first use and kept for the next frames
+        std::unique_ptr<WorkerPool> _pool;
+        PreprocessTimes _preprocessTimes;
         double _diagonalLength = 0.0;
         double _diagonalAngle = 0.0;
         
-        void preprocess(cv::Mat* rawImage);
+        void preprocess(const cv::Mat& rawImage);
+        void smooth(const cv::Mat& image, cv::Mat& smoothed);
+        static void convertToGray(const cv::Mat& image, cv::Mat& gray);
         void prepareCosSin(std::vector<Angle>& table);
+        static bool isMoreVoted(const Line& a, const Line& b);
         static bool isFindingMeaningful(cv::Size& imageSize, float rho, cv::Vec3f& theta, float diagonalAngle);
-        static bool didFindLine(cv::Mat* image, float rho, cv::Vec3f& theta, cv::Vec3f& line, int& threshold);
-        static bool isLine(cv::Mat* image, cv::Point& p);
+        // Near-edge mask in the layout read by one walk
+        struct WalkLayout {
+            const cv::Mat* mask;
+            const BitMap* bits;     // Rows of the spans, or nullptr if the walk reads bytes
+            const int* offsets;     // Pixel offset at each step
+            int minorStride;        // Pixel offset of one step along the minor axis
+        };
+        WalkLayout layoutOf(const LineWalk& walk) const;
+        
+        // Appends every accepted run to segments if given, merging runs closer than segmentGap
+        bool didFindLine(const LineWalk& walk, float rho, const Angle& theta, Line& line, int threshold, std::vector<Segment>* segments = nullptr) const;
+        // The walk of didFindLine() from a given entry point. line keeps its rho and theta.
+        bool didFindLineFrom(const LineWalk& walk, int base, Line& line, int threshold, std::vector<Segment>* segments = nullptr) const;
+        bool didFindLineByRuns(int thetaIdx, float rho, Line& line, int threshold) const;
+        // Locality test of the line, by run lengths if they are enabled or by walking
+        bool testLocality(int thetaIdx, float rho, Line& line, int threshold);
+        // Tests up to lockstepLanes rhos of one theta together, entering the image at the given
+        // points of the major axis, and appends the lines found
+        void testLocalityLockstep(int thetaIdx, const float* rhos, const int* bases, int count, int threshold, std::vector<Line>& lines) const;
+        
+        // Chunks of detectNaiveLocalHough(). Each tests every meaningful rho of its thetas.
+        typedef void (LineFinder::*ThetaScan)(int thetaBegin, int thetaEnd, int threshold, bool lockstep, std::vector<Line>& lines, long long& rejected);
+        void scanThetas(int thetaBegin, int thetaEnd, int threshold, bool lockstep, std::vector<Line>& lines, long long& rejected);
+        template <int ResolutionTheta, int ResolutionRho>
+        void scanThetasFixed(int thetaBegin, int thetaEnd, int threshold, bool lockstep, std::vector<Line>& lines, long long& rejected);
+        // Specialized scan of the resolutions in params, or scanThetas()
+        ThetaScan thetaScan() const;
+        void buildRunLengths();
+        static void buildNearEdgeMask(const cv::Mat& edges, cv::Mat& mask);
+        // Clears the accumulator of the global vote and fills its angle tables. Returns its number of rho bins.
+        int prepareVotes();
+        // Local maxima of the accumulator over houghThreshold(), sorted by votes like cv::HoughLines
+        void findPeaks(int numrho, std::vector<Line>& candidates);
+        void voteFused(std::vector<Line>& lines);
+        void voteGradient(std::vector<Line>& candidates);
+        bool refineLine(const Line& coarse, PyramidStrip& strip, Line& line);
+        // Returns the number of tracked lines not found in their window
+        int trackLines(std::vector<Line>& lines);
+        
+        WorkerPool& pool();
         
         inline double diagonalAngle() { return _diagonalAngle; }
         inline double diagonalLength() { return _diagonalLength; }
         
     public:
+        // Long-lived finder for a stream of frames. Call process() for every frame.
+        LineFinder(LineParams params = LineParams());
         LineFinder(cv::Mat* rawImage, LineParams params = LineParams());
-        ~LineFinder();
         
-        cv::Mat& runStandardHough();
-        cv::Mat& runStandardLocalHough();
-        cv::Mat& runNaiveLocalHough();
+        // Preprocesses a new frame, reusing the buffers of the previous frames
+        void process(const cv::Mat& frame);
+        // Preprocesses a luma plane in place, without copying or converting it.
+        // NV12, NV21, I420 and YV12 buffers start with their Y plane, so they can be passed as they are.
+        // The memory must stay valid until the detection of this frame is done.
+        void process(const uchar* luma, cv::Size size, size_t stride);
+        
+        // Detection only. Lines are written into the given vector, and nothing is drawn.
+        void detect(HoughMode mode, std::vector<Line>& lines);
+        void detectStandardHough(std::vector<Line>& lines);
+        void detectStandardLocalHough(std::vector<Line>& lines);
+        void detectNaiveLocalHough(std::vector<Line>& lines);
+        // Votes and tests locality in one pass. Same lines as detectStandardLocalHough() when it walks,
+        // i.e. without runLengthDirections. See voteFused().
+        void detectFusedLocalHough(std::vector<Line>& lines);
+        void detectGradientLocalHough(std::vector<Line>& lines);
+        // Lines are found on the worksheet and refined on the full resolution frame.
+        // Unlike the other modes, lines are in the coordinates of the frame given to process().
+        void detectPyramidLocalHough(std::vector<Line>& lines);
+        // For a stream of frames. Only tests the neighbourhood of the lines found in the
+        // previous frame, and falls back to detectStandardLocalHough() periodically,
+        // or as soon as a tracked line is lost.
+        void detectTrackedLocalHough(std::vector<Line>& lines);
+        void resetTracking();
+        // For a hard time budget. Tests the candidates of detectStandardLocalHough() from the most
+        // voted one down, and stops at the deadline with the lines confirmed so far.
+        // Returns true if every candidate was tested before the deadline.
+        // The global vote cannot be interrupted, so it may take the whole budget by itself.
+        bool detectAnytimeLocalHough(std::chrono::steady_clock::time_point deadline, std::vector<Line>& lines);
+        bool detectAnytimeLocalHough(double budgetMs, std::vector<Line>& lines);
+        
+        // Segments of detectStandardLocalHough(), like cv::HoughLinesP. Each is a run of line pixels,
+        // or runs of the same line at most segmentGap pixels apart, found by the same walk.
+        // Segments are in worksheet coordinates, and line[2] is the number of line pixels.
+        void detectLocalSegments(std::vector<Segment>& segments);
+        // Segments of the given lines, which are in worksheet coordinates, e.g. the lines of another mode
+        void findSegments(const std::vector<Line>& lines, std::vector<Segment>& segments);
+        
+        // The stages of detectStandardLocalHough()
+        void detectCandidates(std::vector<Line>& candidates);
+        // Between the two, drops the candidates next to a more voted one if candidateMergeRho
+        // and candidateMergeTheta are set. Does nothing otherwise, not even sorting.
+        void suppressCandidates(std::vector<Line>& candidates);
+        void filterByLocality(const std::vector<Line>& candidates, std::vector<Line>& lines);
+        
+        // Detection and drawing the lines on a new copy of the preprocessed image,
+        // so the images of earlier calls stay as they were. The detect*() calls draw nothing.
+        cv::Mat runStandardHough();
+        cv::Mat runStandardLocalHough();
+        cv::Mat runNaiveLocalHough();
+        cv::Mat runFusedLocalHough();
+        cv::Mat runGradientLocalHough();
+        cv::Mat runLocalSegments();
         cv::Mat& preprocessedImage();
+        const PreprocessTimes& preprocessTimes();
+        // Bytes taken by the run-length transform
+        size_t runLengthMemory();
+        // Lines found by the last run*Hough() call
+        const std::vector<Line>& lines();
+        // Segments found by the last runLocalSegments() call
+        const std::vector<Segment>& segments();
     };
 }
 
@@ -0,0 +1,144 @@
+//
+//  LinePipeline.cpp
+//  local-hough-line-cpp
+//
+//  Created by 박성현 on 17/10/2026.
+//  Copyright © 2019 Sean Park. All rights reserved.
+//
+
+#include "LinePipeline.hpp"
+#include <stdexcept>
+
+namespace fh {
+    
+    LinePipeline::LinePipeline(PipelineParams params):
+        params(params),
+        _idle(MAX(params.depth, 1)),
+        _toPreprocess(MAX(params.depth, 1)),
+        _toVote(MAX(params.depth, 1)),
+        _toTest(MAX(params.depth, 1)) {
+        // Stages are spread over threads already, so each detection runs on a single thread
+        LineParams lineParams = params.lineParams;
+        lineParams.threads = 1;
+        for (int i = 0; i < MAX(params.depth, 1); i++) {
+            _finders.emplace_back(new LineFinder(lineParams));
+            _idle.push(_finders.back().get());
+        }
+        
+        HoughMode mode = params.mode;
+        _stages.emplace_back([this]() {
+            runStage(_toPreprocess, _toVote, [](Job& job) {
+                job.finder->process(job.frame);
+            });
+        });
+        _stages.emplace_back([this, mode]() {
+            runStage(_toVote, _toTest, [mode](Job& job) {
+                if (mode == HoughMode::StandardLocal) {
+                    job.finder->detectCandidates(job.candidates);
+                    job.finder->suppressCandidates(job.candidates);
+                } else {
+                    job.finder->detect(mode, job.result.lines);
+                }
+            });
+        });
+        _stages.emplace_back([this, mode]() {
+            JobPtr job;
+            while (_toTest.pop(job)) {
+                if (!job->result.error && mode == HoughMode::StandardLocal) {
+                    try {
+                        job->finder->filterByLocality(job->candidates, job->result.lines);
+                    } catch (...) {
+                        job->result.error = std::current_exception();
+                    }
+                }
+                finish(*job);
+            }
+        });
+    }
+    
+    LinePipeline::~LinePipeline() {
+        close();
+    }
+    
+    std::future<std::vector<Line>> LinePipeline::submit(const cv::Mat& frame) {
+        JobPtr job(new Job());
+        std::future<std::vector<Line>> future = job->promise.get_future();
+        enqueue(std::move(job), frame);
+        return future;
+    }
+    
+    void LinePipeline::submit(const cv::Mat& frame, Callback callback) {
+        JobPtr job(new Job());
+        job->callback = std::move(callback);
+        enqueue(std::move(job), frame);
+    }
+    
+    // Called by the submitting thread only
+    void LinePipeline::enqueue(JobPtr job, const cv::Mat& frame) {
+        job->index = _submitted++;
+        job->result.index = job->index;
+        job->frame = frame;
+        
+        // Waits for a frame in flight to finish when every LineFinder is busy
+        if (_closed || !_idle.pop(job->finder)) {
+            job->result.error = std::make_exception_ptr(std::runtime_error("LinePipeline is closed"));
+            finish(*job);
+            return;
+        }
+        _toPreprocess.push(std::move(job));
+    }
+    
+    // Stages are single threaded and queues are FIFO, so frames leave in the order they came.
+    // A frame which failed passes through the remaining stages untouched.
+    void LinePipeline::runStage(SpscQueue<JobPtr>& input, SpscQueue<JobPtr>& output, const std::function<void(Job&)>& work) {
+        JobPtr job;
+        while (input.pop(job)) {
+            if (!job->result.error) {
+                try {
+                    work(*job);
+                } catch (...) {
+                    job->result.error = std::current_exception();
+                }
+            }
+            output.push(std::move(job));
+        }
+        output.close();
+    }
+    
+    void LinePipeline::finish(Job& job) {
+        if (job.result.error) {
+            job.result.lines.clear();
+        }
+        
+        // The result belongs to the job, so the frame and its LineFinder are given back
+        // before the caller sees it, and a callback which throws cannot hold them.
+        job.frame.release();
+        if (job.finder) {
+            _idle.push(job.finder);
+            job.finder = nullptr;
+        }
+        
+        if (job.callback) {
+            // An exception leaving the stage thread would terminate the process
+            try {
+                job.callback(job.result);
+            } catch (...) {
+            }
+        } else if (job.result.error) {
+            job.promise.set_exception(job.result.error);
+        } else {
+            job.promise.set_value(job.result.lines);
+        }
+    }
+    
+    void LinePipeline::close() {
+        if (_closed) {
+            return;
+        }
+        _closed = true;
+        _toPreprocess.close();
+        for (auto& stage: _stages) {
+            stage.join();
+        }
+    }
+}
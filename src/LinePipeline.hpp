@@ -0,0 +1,97 @@
+//
+//  LinePipeline.hpp
+//  local-hough-line-cpp
+//
+//  Created by 박성현 on 17/10/2026.
+//  Copyright © 2019 Sean Park. All rights reserved.
+//
+
+#ifndef LinePipeline_hpp
+#define LinePipeline_hpp
+
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <opencv2/core.hpp>
+#include "LineFinder.hpp"
+#include "Helper.hpp"
+
+namespace fh {
+    
+    class PipelineParams {
+    public:
+        HoughMode mode = HoughMode::StandardLocal;
+        // Frames in flight. submit() blocks while this many are unfinished.
+        // At least 3 keep every stage busy.
+        int depth = 4;
+        
+        LineParams lineParams;
+    };
+    
+    // Lines of one submitted frame, in submission order
+    struct FrameResult {
+        uint64_t index = 0;
+        std::vector<Line> lines;
+        // Set if a stage threw. lines is empty then.
+        std::exception_ptr error;
+    };
+    
+    // Detects lines on a stream of frames with preprocessing, voting and the locality test
+    // on separate threads, so the stages of consecutive frames overlap and throughput follows
+    // the slowest stage instead of the sum of them. Modes other than StandardLocal run their
+    // whole detection in the voting stage.
+    // Each frame in flight owns a LineFinder, so no stage shares buffers with another.
+    // Each stage is one thread, so the LineFinders run their detections on a single thread.
+    // Results are delivered in submission order. Frames are submitted from one thread.
+    class LinePipeline {
+    public:
+        typedef std::function<void(const FrameResult& result)> Callback;
+        
+        LinePipeline(PipelineParams params = PipelineParams());
+        // Finishes the frames in flight
+        ~LinePipeline();
+        
+        // The pipeline keeps a reference to the frame's pixels until its lines are found,
+        // so a frame whose buffer is reused by the caller must be cloned first.
+        std::future<std::vector<Line>> submit(const cv::Mat& frame);
+        // The callback is called on the last stage's thread. Exceptions it throws are dropped.
+        void submit(const cv::Mat& frame, Callback callback);
+        
+        // Waits until every submitted frame is finished. No frame can be submitted afterwards.
+        void close();
+        
+    private:
+        struct Job {
+            uint64_t index = 0;
+            cv::Mat frame;
+            LineFinder* finder = nullptr;
+            std::vector<Line> candidates;
+            FrameResult result;
+            std::promise<std::vector<Line>> promise;
+            Callback callback;
+        };
+        typedef std::unique_ptr<Job> JobPtr;
+        
+        PipelineParams params;
+        std::vector<std::unique_ptr<LineFinder>> _finders;
+        // LineFinders of no frame in flight, given back by the last stage to the submitting thread.
+        // Every queue has one thread on each side, so none of them takes a lock while frames flow.
+        SpscQueue<LineFinder*> _idle;
+        SpscQueue<JobPtr> _toPreprocess;
+        SpscQueue<JobPtr> _toVote;
+        SpscQueue<JobPtr> _toTest;
+        std::vector<std::thread> _stages;
+        uint64_t _submitted = 0;
+        bool _closed = false;
+        
+        void enqueue(JobPtr job, const cv::Mat& frame);
+        void runStage(SpscQueue<JobPtr>& input, SpscQueue<JobPtr>& output, const std::function<void(Job&)>& work);
+        void finish(Job& job);
+    };
+}
+
+#endif /* LinePipeline_hpp */
@@ -0,0 +1,90 @@
+//
+//  LineWalkCache.cpp
+//  local-hough-line-cpp
+//
+//  Created by 박성현 on 17/10/2026.
+//  Copyright © 2019 Sean Park. All rights reserved.
+//
+
+#include "LineWalkCache.hpp"
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <tuple>
+
+namespace fh {
+    
+    // Shortest average row of a walk read from bit-packed rows
+    static const int packedSpanLength = 8;
+    
+    void LineWalk::clip(int base, int& begin, int& end) const {
+        // minor is monotonic, so the steps inside the image are contiguous
+        if (minor.empty() || minor.back() >= minor.front()) {
+            begin = int(std::lower_bound(minor.begin(), minor.end(), -base) - minor.begin());
+            end = int(std::lower_bound(minor.begin(), minor.end(), minorLength - base) - minor.begin());
+        } else {
+            begin = int(std::lower_bound(minor.begin(), minor.end(), minorLength - 1 - base, std::greater<int>()) - minor.begin());
+            end = int(std::upper_bound(minor.begin(), minor.end(), -base, std::greater<int>()) - minor.begin());
+        }
+        end = MAX(begin, end);
+    }
+    
+    LineWalkCache::LineWalkCache(cv::Size size, int resolutionTheta) {
+        _size = size;
+        _walks.resize(resolutionTheta);
+        
+        for (int i = 0; i < resolutionTheta; i++) {
+            double theta = CV_PI * i / resolutionTheta;
+            double tcos = cos(theta);
+            double tsin = sin(theta);
+            
+            // Line direction is (-sin, cos)
+            LineWalk& walk = _walks[i];
+            walk.alongY = fabs(tcos) >= fabs(tsin);
+            int majorLength = walk.alongY ? size.height : size.width;
+            walk.minorLength = walk.alongY ? size.width : size.height;
+            double slope = walk.alongY ? -tsin / tcos : -tcos / tsin;
+            
+            walk.minor.resize(majorLength);
+            walk.offsets.resize(majorLength);
+            if (walk.alongY) {
+                walk.transposedOffsets.resize(majorLength);
+            }
+            for (int t = 0; t < majorLength; t++) {
+                int m = cvRound(t * slope);
+                walk.minor[t] = m;
+                walk.offsets[t] = walk.alongY ? (t * size.width + m) : (m * size.width + t);
+                if (walk.alongY) {
+                    walk.transposedOffsets[t] = m * size.height + t;
+                }
+            }
+            
+            // Rows of shallow walks, or of steep walks in the transposed image,
+            // are long enough to be read by words
+            if (fabs(slope) <= 1.0 / packedSpanLength) {
+                for (int t = 1; t < majorLength; t++) {
+                    if (walk.minor[t] != walk.minor[t - 1]) {
+                        walk.spanEnds.push_back(t);
+                    }
+                }
+                walk.spanEnds.push_back(majorLength);
+            }
+        }
+    }
+    
+    std::shared_ptr<const LineWalkCache> LineWalkCache::get(cv::Size size, int resolutionTheta) {
+        typedef std::tuple<int, int, int> Key;
+        static std::mutex mutex;
+        static std::map<Key, std::weak_ptr<const LineWalkCache>> caches;
+        
+        std::lock_guard<std::mutex> lock(mutex);
+        Key key(size.width, size.height, resolutionTheta);
+        auto cache = caches[key].lock();
+        if (!cache) {
+            cache = std::shared_ptr<const LineWalkCache>(new LineWalkCache(size, resolutionTheta));
+            caches[key] = cache;
+        }
+        return cache;
+    }
+}
@@ -0,0 +1,56 @@
+//
+//  LineWalkCache.hpp
+//  local-hough-line-cpp
+//
+//  Created by 박성현 on 17/10/2026.
+//  Copyright © 2019 Sean Park. All rights reserved.
+//
+
+#ifndef LineWalkCache_hpp
+#define LineWalkCache_hpp
+
+#include <memory>
+#include <vector>
+#include <opencv2/core.hpp>
+
+namespace fh {
+    
+    // Pixels visited by a line of one angle, one pixel per step along the major axis.
+    // Lines of the same angle are translations of each other along the minor axis,
+    // so a line starting at minor position `base` visits base + minor[t] at step t.
+    // Both base and minor[t] are rounded, so a walk may be a pixel off its line, and its pixels
+    // differ from the ones of cv::LineIterator, which the original locality test followed.
+    struct LineWalk {
+        bool alongY = true;         // Major axis is y, i.e. the line is closer to vertical
+        int minorLength = 0;        // Width of the image if alongY, else height
+        std::vector<int> minor;     // Minor axis position at each step, relative to step 0
+        std::vector<int> offsets;   // Pixel offset at each step, relative to step 0
+        // For walks along y only. Pixel offset at each step in the transposed image,
+        // where the walk moves along rows and changes row only when its minor position does.
+        std::vector<int> transposedOffsets;
+        // For shallow walks along x, and steep walks along y in the transposed image.
+        // Steps [spanEnds[k - 1], spanEnds[k]) stay on one row, so they can be read
+        // from a bit-packed row a word at a time.
+        std::vector<int> spanEnds;
+        
+        // Steps [begin, end) which stay inside the image, for a line starting at base
+        void clip(int base, int& begin, int& end) const;
+    };
+    
+    // Line walks for every angle of a worksheet size and theta resolution.
+    // Built once and shared read-only, so any number of LineFinders and threads can use it.
+    class LineWalkCache {
+        cv::Size _size;
+        std::vector<LineWalk> _walks;
+        
+        LineWalkCache(cv::Size size, int resolutionTheta);
+        
+    public:
+        static std::shared_ptr<const LineWalkCache> get(cv::Size size, int resolutionTheta);
+        
+        inline const LineWalk& walk(int thetaIdx) const { return _walks[thetaIdx]; }
+        inline cv::Size size() const { return _size; }
+    };
+}
+
+#endif /* LineWalkCache_hpp */
@@ -0,0 +1,210 @@
+//
+//  LockstepWalker.cpp
+//  local-hough-line-cpp
+//
+//  Created by 박성현 on 17/10/2026.
+//  Copyright © 2019 Sean Park. All rights reserved.
+//
+
+#include "LockstepWalker.hpp"
+#include <algorithm>
+#include <climits>
+
+// Vector walkers are compiled for their own instruction sets and picked at runtime,
+// so the rest of the project keeps its default target
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define FH_LOCKSTEP_X86 1
+#include <immintrin.h>
+#endif
+
+namespace fh {
+    
+    SimdLevel simdLevel() {
+        static const SimdLevel level = []() {
+#ifdef FH_LOCKSTEP_X86
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx2")) {
+                return SimdLevel::AVX2;
+            }
+            if (__builtin_cpu_supports("sse4.1")) {
+                return SimdLevel::SSE4;
+            }
+#endif
+            return SimdLevel::Scalar;
+        }();
+        return level;
+    }
+    
+    const char* simdLevelName(SimdLevel level) {
+        switch (level) {
+            case SimdLevel::AVX2:
+                return "avx2";
+            case SimdLevel::SSE4:
+                return "sse4";
+            default:
+                return "scalar";
+        }
+    }
+    
+    // Lanes of one walkLockstep() call, padded with empty lanes
+    struct Lanes {
+        alignas(32) int origins[lockstepLanes];
+        alignas(32) int begins[lockstepLanes];
+        alignas(32) int ends[lockstepLanes];
+        alignas(32) int scores[lockstepLanes];
+        alignas(32) int runs[lockstepLanes];
+        int first = INT_MAX;    // Steps walked by any lane
+        int last = 0;
+        
+        Lanes(int lanes, const int* origins, const int* begins, const int* ends) {
+            for (int k = 0; k < lockstepLanes; k++) {
+                bool isUsed = k < lanes && begins[k] < ends[k];
+                this->origins[k] = isUsed ? origins[k] : 0;
+                this->begins[k] = isUsed ? begins[k] : 0;
+                this->ends[k] = isUsed ? ends[k] : 0;
+                if (isUsed) {
+                    first = MIN(first, begins[k]);
+                    last = MAX(last, ends[k]);
+                }
+            }
+        }
+    };
+    
+    static void walkScalar(const uchar* data, const int* offsets, Lanes& lanes, int threshold, bool countBorderRuns) {
+        for (int k = 0; k < lockstepLanes; k++) {
+            const uchar* origin = data + lanes.origins[k];
+            int votes = 0;
+            int score = 0;
+            int runs = 0;
+            for (int i = lanes.begins[k]; i < lanes.ends[k]; i++) {
+                if (origin[offsets[i]] != 0) {
+                    ++votes;
+                    continue;
+                }
+                if (votes > threshold) {
+                    score += votes;
+                    ++runs;
+                }
+                votes = 0;
+            }
+            // The last run may reach the border of the image
+            if (countBorderRuns && votes > threshold) {
+                score += votes;
+                ++runs;
+            }
+            lanes.scores[k] = score;
+            lanes.runs[k] = runs;
+        }
+    }
+    
+#ifdef FH_LOCKSTEP_X86
+    // Every lane is a 32 bit counter. A lane outside its steps reads as an empty pixel,
+    // which leaves it at zero before the beginning. Without countBorderRuns, the run of a lane
+    // reaching its end is dropped there instead of closed.
+    
+    __attribute__((target("sse4.1")))
+    static void walkSSE4(const uchar* data, const int* offsets, Lanes& lanes, int threshold, bool countBorderRuns) {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i one = _mm_set1_epi32(1);
+        const __m128i limit = _mm_set1_epi32(threshold);
+        const __m128i keepBorder = countBorderRuns ? _mm_set1_epi32(-1) : zero;
+        
+        for (int half = 0; half < lockstepLanes; half += 4) {
+            const int* origins = lanes.origins + half;
+            const int* begins = lanes.begins + half;
+            const int* ends = lanes.ends + half;
+            const __m128i laneEnds = _mm_load_si128((const __m128i*)ends);
+            __m128i votes = zero;
+            __m128i score = zero;
+            __m128i runs = zero;
+            
+            for (int i = lanes.first; i < lanes.last; i++) {
+                int offset = offsets[i];
+                auto pixel = [&](int k) -> int {
+                    return (i >= begins[k] && i < ends[k]) ? data[origins[k] + offset] : 0;
+                };
+                // No gathers before AVX2, so lanes are loaded one by one
+                __m128i pixels = _mm_cvtsi32_si128(pixel(0));
+                pixels = _mm_insert_epi32(pixels, pixel(1), 1);
+                pixels = _mm_insert_epi32(pixels, pixel(2), 2);
+                pixels = _mm_insert_epi32(pixels, pixel(3), 3);
+                
+                __m128i isEmpty = _mm_cmpeq_epi32(pixels, zero);
+                __m128i isClosing = _mm_or_si128(keepBorder, _mm_cmpgt_epi32(laneEnds, _mm_set1_epi32(i)));
+                __m128i closes = _mm_and_si128(_mm_and_si128(isEmpty, isClosing), _mm_cmpgt_epi32(votes, limit));
+                score = _mm_add_epi32(score, _mm_and_si128(votes, closes));
+                runs = _mm_sub_epi32(runs, closes);
+                votes = _mm_andnot_si128(isEmpty, _mm_add_epi32(votes, one));
+            }
+            __m128i closes = _mm_and_si128(keepBorder, _mm_cmpgt_epi32(votes, limit));
+            score = _mm_add_epi32(score, _mm_and_si128(votes, closes));
+            runs = _mm_sub_epi32(runs, closes);
+            _mm_store_si128((__m128i*)(lanes.scores + half), score);
+            _mm_store_si128((__m128i*)(lanes.runs + half), runs);
+        }
+    }
+    
+    __attribute__((target("avx2")))
+    static void walkAVX2(const uchar* data, int total, const int* offsets, Lanes& lanes, int threshold, bool countBorderRuns) {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i one = _mm256_set1_epi32(1);
+        const __m256i byte = _mm256_set1_epi32(0xFF);
+        const __m256i limit = _mm256_set1_epi32(threshold);
+        const __m256i keepBorder = countBorderRuns ? _mm256_set1_epi32(-1) : zero;
+        // Gathers read 4 bytes, so the last pixels are read from the last whole word of the mask
+        const __m256i lastWord = _mm256_set1_epi32(total - 4);
+        const __m256i origins = _mm256_load_si256((const __m256i*)lanes.origins);
+        const __m256i begins = _mm256_load_si256((const __m256i*)lanes.begins);
+        const __m256i ends = _mm256_load_si256((const __m256i*)lanes.ends);
+        __m256i votes = zero;
+        __m256i score = zero;
+        __m256i runs = zero;
+        
+        for (int i = lanes.first; i < lanes.last; i++) {
+            __m256i step = _mm256_set1_epi32(i);
+            // begin <= i < end
+            __m256i isInside = _mm256_andnot_si256(_mm256_cmpgt_epi32(begins, step), _mm256_cmpgt_epi32(ends, step));
+            __m256i index = _mm256_and_si256(_mm256_add_epi32(origins, _mm256_set1_epi32(offsets[i])), isInside);
+            __m256i word = _mm256_min_epi32(index, lastWord);
+            __m256i shift = _mm256_slli_epi32(_mm256_sub_epi32(index, word), 3);
+            __m256i pixels = _mm256_i32gather_epi32((const int*)data, word, 1);
+            pixels = _mm256_and_si256(_mm256_srlv_epi32(pixels, shift), byte);
+            
+            __m256i isLine = _mm256_andnot_si256(_mm256_cmpeq_epi32(pixels, zero), isInside);
+            __m256i isClosing = _mm256_or_si256(keepBorder, _mm256_cmpgt_epi32(ends, step));
+            __m256i closes = _mm256_and_si256(_mm256_andnot_si256(isLine, isClosing), _mm256_cmpgt_epi32(votes, limit));
+            score = _mm256_add_epi32(score, _mm256_and_si256(votes, closes));
+            runs = _mm256_sub_epi32(runs, closes);
+            votes = _mm256_and_si256(_mm256_add_epi32(votes, one), isLine);
+        }
+        __m256i closes = _mm256_and_si256(keepBorder, _mm256_cmpgt_epi32(votes, limit));
+        score = _mm256_add_epi32(score, _mm256_and_si256(votes, closes));
+        runs = _mm256_sub_epi32(runs, closes);
+        _mm256_store_si256((__m256i*)lanes.scores, score);
+        _mm256_store_si256((__m256i*)lanes.runs, runs);
+    }
+#endif
+    
+    void walkLockstep(SimdLevel level, const cv::Mat& mask, const int* offsets, int lanes,
+                      const int* origins, const int* begins, const int* ends, int threshold,
+                      bool countBorderRuns, int* scores, int* runs) {
+        lanes = MIN(lanes, lockstepLanes);
+        Lanes padded(lanes, origins, begins, ends);
+        const uchar* data = mask.data;
+        int total = (int)mask.total();
+        
+#ifdef FH_LOCKSTEP_X86
+        if (level == SimdLevel::AVX2 && total >= 4) {
+            walkAVX2(data, total, offsets, padded, threshold, countBorderRuns);
+        } else if (level != SimdLevel::Scalar) {
+            walkSSE4(data, offsets, padded, threshold, countBorderRuns);
+        } else {
+            walkScalar(data, offsets, padded, threshold, countBorderRuns);
+        }
+#else
+        walkScalar(data, offsets, padded, threshold, countBorderRuns);
+#endif
+        std::copy(padded.scores, padded.scores + lanes, scores);
+        std::copy(padded.runs, padded.runs + lanes, runs);
+    }
+}
@@ -0,0 +1,40 @@
+//
+//  LockstepWalker.hpp
+//  local-hough-line-cpp
+//
+//  Created by 박성현 on 17/10/2026.
+//  Copyright © 2019 Sean Park. All rights reserved.
+//
+
+#ifndef LockstepWalker_hpp
+#define LockstepWalker_hpp
+
+#include <opencv2/core.hpp>
+
+namespace fh {
+    
+    enum class SimdLevel {
+        Scalar,
+        SSE4,
+        AVX2,
+    };
+    
+    // Best level supported by the CPU running this process, detected once
+    SimdLevel simdLevel();
+    const char* simdLevelName(SimdLevel level);
+    
+    // Lines walked together by walkLockstep()
+    static const int lockstepLanes = 8;
+    
+    // Walks up to lockstepLanes lines of the same angle at once. Lines of one angle share
+    // the step pattern of their walk, so every lane reads mask[origins[k] + offsets[i]] at step i.
+    // offsets are LineWalk::offsets, or LineWalk::transposedOffsets on a transposed mask.
+    // Lane k counts steps [begins[k], ends[k]), and an empty range leaves the lane out.
+    // Writes the sum of runs longer than threshold to scores[k] and their number to runs[k],
+    // exactly as didFindLine() counts a single line. The run reaching ends[k] counts only with countBorderRuns.
+    void walkLockstep(SimdLevel level, const cv::Mat& mask, const int* offsets, int lanes,
+                      const int* origins, const int* begins, const int* ends, int threshold,
+                      bool countBorderRuns, int* scores, int* runs);
+}
+
+#endif /* LockstepWalker_hpp */
@@ -0,0 +1,146 @@
+//
+//  Profiler.cpp
+//  local-hough-line-cpp
+//
+//  Created by 박성현 on 17/10/2026.
+//  Copyright © 2019 Sean Park. All rights reserved.
+//
+
+#include "Profiler.hpp"
+#include <algorithm>
+
+namespace fh {
+    
+    Profiler::Profiler() {
+        for (auto& counter: _counters) {
+            counter = 0;
+        }
+    }
+    
+    Profiler& Profiler::instance() {
+        static Profiler profiler;
+        return profiler;
+    }
+    
+    Profiler::PendingCounts& Profiler::pending() {
+        static thread_local PendingCounts counts;
+        return counts;
+    }
+    
+    Profiler::PendingCounts::~PendingCounts() {
+        auto& totals = Profiler::instance()._counters;
+        for (int i = 0; i < (int)Counter::Count; i++) {
+            totals[i].fetch_add(counts[i], std::memory_order_relaxed);
+        }
+    }
+    
+    void Profiler::flushCounters() {
+        auto& counts = pending().counts;
+        for (int i = 0; i < (int)Counter::Count; i++) {
+            if (counts[i] != 0) {
+                _counters[i].fetch_add(counts[i], std::memory_order_relaxed);
+                counts[i] = 0;
+            }
+        }
+    }
+    
+    const char* Profiler::counterName(Counter counter) {
+        switch (counter) {
+            case Counter::CandidateLines: return "candidateLines";
+            case Counter::MergedCandidates: return "mergedCandidates";
+            case Counter::RejectedPairs: return "rejectedPairs";
+            case Counter::WalkedPixels: return "walkedPixels";
+            case Counter::AcceptedRuns: return "acceptedRuns";
+            case Counter::Count: break;
+        }
+        return "";
+    }
+    
+    void Profiler::record(const std::string& path, double ms) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto found = _stages.find(path);
+        if (found == _stages.end()) {
+            found = _stages.emplace(path, ProfileStage()).first;
+            found->second.path = path;
+        }
+        auto& stage = found->second;
+        ++stage.calls;
+        stage.totalMs += ms;
+        stage.maxMs = std::max(stage.maxMs, ms);
+    }
+    
+    std::vector<ProfileStage> Profiler::stages() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        std::vector<ProfileStage> stages;
+        for (auto& entry: _stages) {
+            stages.push_back(entry.second);
+        }
+        return stages;
+    }
+    
+    long long Profiler::counter(Counter counter) const {
+        const_cast<Profiler*>(this)->flushCounters();
+        return _counters[(int)counter].load(std::memory_order_relaxed);
+    }
+    
+    void Profiler::reset() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stages.clear();
+        for (auto& count: pending().counts) {
+            count = 0;
+        }
+        for (auto& counter: _counters) {
+            counter = 0;
+        }
+    }
+    
+    void Profiler::print(std::ostream& out) const {
+        for (auto& stage: stages()) {
+            // Indent by depth, and print the last name only
+            size_t depth = std::count(stage.path.begin(), stage.path.end(), '/');
+            size_t slash = stage.path.find_last_of('/');
+            std::string name = slash == std::string::npos ? stage.path : stage.path.substr(slash + 1);
+            out << "[Profile] " << std::string(depth * 2, ' ') << name
+                << ": " << stage.calls << " calls, " << stage.totalMs << "ms total, "
+                << stage.totalMs / stage.calls << "ms mean, " << stage.maxMs << "ms max" << std::endl;
+        }
+        for (int i = 0; i < (int)Counter::Count; i++) {
+            out << "[Profile] " << counterName((Counter)i) << ": " << counter((Counter)i) << std::endl;
+        }
+    }
+    
+    std::string& ProfileScope::currentPath() {
+        static thread_local std::string path;
+        return path;
+    }
+    
+    ProfileScope::ProfileScope(const char* name) {
+        auto& path = currentPath();
+        _parentLength = path.size();
+        if (!path.empty()) {
+            path += '/';
+        }
+        path += name;
+        _start = std::chrono::steady_clock::now();
+    }
+    
+    ProfileScope::~ProfileScope() {
+        auto end = std::chrono::steady_clock::now();
+        auto& path = currentPath();
+        auto& profiler = Profiler::instance();
+        profiler.record(path, std::chrono::duration<double, std::milli>(end - _start).count());
+        profiler.flushCounters();
+        path.resize(_parentLength);
+    }
+    
+    void ProfileScope::record(const char* name, double ms) {
+        auto& path = currentPath();
+        size_t parentLength = path.size();
+        if (!path.empty()) {
+            path += '/';
+        }
+        path += name;
+        Profiler::instance().record(path, ms);
+        path.resize(parentLength);
+    }
+}
@@ -0,0 +1,112 @@
+//
+//  Profiler.hpp
+//  local-hough-line-cpp
+//
+//  Created by 박성현 on 17/10/2026.
+//  Copyright © 2019 Sean Park. All rights reserved.
+//
+
+#ifndef Profiler_hpp
+#define Profiler_hpp
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Build with FH_PROFILE defined to record stages and counters.
+// Otherwise every FH_PROFILE_* and FH_COUNT macro compiles to nothing.
+#ifdef FH_PROFILE
+#define FH_PROFILE_CONCAT_(a, b) a##b
+#define FH_PROFILE_CONCAT(a, b) FH_PROFILE_CONCAT_(a, b)
+// Times the enclosing block as a child of the stage it runs in
+#define FH_PROFILE_SCOPE(name) fh::ProfileScope FH_PROFILE_CONCAT(profileScope, __LINE__)(name)
+// Records a child stage which was timed by the caller
+#define FH_PROFILE_RECORD(name, ms) fh::ProfileScope::record(name, ms)
+// Adds to a counter of this thread, merged into the totals when a stage of the thread ends
+#define FH_COUNT(counter, n) fh::Profiler::add(fh::Counter::counter, n)
+// Merges the counters of this thread. For worker threads, which run no stage of their own.
+#define FH_COUNT_FLUSH() fh::Profiler::instance().flushCounters()
+#else
+#define FH_PROFILE_SCOPE(name)
+#define FH_PROFILE_RECORD(name, ms)
+#define FH_COUNT(counter, n)
+#define FH_COUNT_FLUSH()
+#endif
+
+namespace fh {
+    
+    enum class Counter {
+        CandidateLines,     // Lines given to the locality test by cv::HoughLines
+        MergedCandidates,   // Candidates dropped by suppressCandidates() next to a stronger one
+        RejectedPairs,      // (rho, theta) pairs rejected by isFindingMeaningful()
+        WalkedPixels,       // Pixels read by didFindLine()
+        AcceptedRuns,       // Runs longer than the local threshold
+        Count,
+    };
+    
+    struct ProfileStage {
+        std::string path;   // Names of the enclosing stages and this stage, joined by '/'
+        long long calls = 0;
+        double totalMs = 0.0;
+        double maxMs = 0.0;
+    };
+    
+    // Collects stages and counters from every thread
+    class Profiler {
+        mutable std::mutex _mutex;
+        std::map<std::string, ProfileStage> _stages;
+        std::atomic<long long> _counters[(int)Counter::Count];
+        
+        // Counts of one thread which are not merged yet. Threads add to their own counts,
+        // so walks on several threads do not contend on the shared ones.
+        struct PendingCounts {
+            long long counts[(int)Counter::Count] = {};
+            // Merges what is left when the thread exits
+            ~PendingCounts();
+        };
+        static PendingCounts& pending();
+        
+        Profiler();
+        
+    public:
+        static Profiler& instance();
+        static const char* counterName(Counter counter);
+        
+        void record(const std::string& path, double ms);
+        static inline void add(Counter counter, long long n) {
+            pending().counts[(int)counter] += n;
+        }
+        // Merges the counts of the calling thread into the totals. Called when a stage ends.
+        void flushCounters();
+        
+        // Stages sorted by path, so children follow their parents
+        std::vector<ProfileStage> stages() const;
+        // Totals of the merged counts, after merging the calling thread's
+        long long counter(Counter counter) const;
+        // Counts of other threads not merged yet are kept
+        void reset();
+        void print(std::ostream& out) const;
+    };
+    
+    // Times its lifetime as a stage. Stages opened on the same thread nest.
+    class ProfileScope {
+        typedef std::chrono::time_point<std::chrono::steady_clock> Time;
+        
+        Time _start;
+        size_t _parentLength;
+        
+        static std::string& currentPath();
+        
+    public:
+        ProfileScope(const char* name);
+        ~ProfileScope();
+        
+        static void record(const char* name, double ms);
+    };
+}
+
+#endif /* Profiler_hpp */
@@ -0,0 +1,315 @@
+//
+//  Sweep.cpp
+//  local-hough-line-cpp
+//
+//  Created by 박성현 on 17/10/2026.
+//  Copyright © 2019 Sean Park. All rights reserved.
+//
+
+#include "Sweep.hpp"
+#include "Helper.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <exception>
+#include <thread>
+#include <opencv2/imgcodecs.hpp>
+
+namespace fh {
+    
+    bool setLineParam(LineParams& params, const std::string& name, int value) {
+        // Values OpenCV or the tables would reject are refused here, before any detection runs
+        if (name == "worksheetLength") {
+            if (value < 1) {
+                return false;
+            }
+            params.worksheetLength = value;
+        } else if (name == "bilateralColorS") {
+            if (value < 0) {
+                return false;
+            }
+            params.bilateralColorS = value;
+        } else if (name == "bilateralSpaceS") {
+            if (value < 0) {
+                return false;
+            }
+            params.bilateralSpaceS = value;
+        } else if (name == "smoothing") {
+            if (value < 0 || value > (int)Smoothing::None) {
+                return false;
+            }
+            params.smoothing = (Smoothing)value;
+        } else if (name == "smoothingKernel") {
+            if (value < 1) {
+                return false;
+            }
+            params.smoothingKernel = value;
+        } else if (name == "grayFirst") {
+            params.grayFirst = value != 0;
+        } else if (name == "cannyAperture") {
+            // cv::Canny takes 3, 5 or 7 only
+            if (value != 3 && value != 5 && value != 7) {
+                return false;
+            }
+            params.cannyAperture = value;
+        } else if (name == "cannyThreshold1") {
+            if (value < 0) {
+                return false;
+            }
+            params.cannyThreshold1 = value;
+        } else if (name == "cannyThreshold2") {
+            if (value < 0) {
+                return false;
+            }
+            params.cannyThreshold2 = value;
+        } else if (name == "cannyUseL2Gradient") {
+            params.cannyUseL2Gradient = value != 0;
+        } else if (name == "houghResolutionTheta") {
+            // prepareCosSin() assumes a multiple of 180
+            if (value < 180 || value % 180 != 0) {
+                return false;
+            }
+            params.houghResolutionTheta = value;
+        } else if (name == "houghResolutionRho") {
+            if (value < 1) {
+                return false;
+            }
+            params.houghResolutionRho = value;
+        } else if (name == "candidateMergeRho") {
+            if (value < 0) {
+                return false;
+            }
+            params.candidateMergeRho = value;
+        } else if (name == "candidateMergeTheta") {
+            if (value < 0) {
+                return false;
+            }
+            params.candidateMergeTheta = value;
+        } else if (name == "gradientWindowTheta") {
+            if (value < 0) {
+                return false;
+            }
+            params.gradientWindowTheta = value;
+        } else {
+            return false;
+        }
+        return true;
+    }
+    
+    bool parseSweepAxis(const std::string& text, SweepAxis& axis) {
+        size_t equal = text.find('=');
+        if (equal == std::string::npos) {
+            return false;
+        }
+        axis.name = text.substr(0, equal);
+        axis.values.clear();
+        
+        LineParams probe;
+        size_t begin = equal + 1;
+        while (begin <= text.size()) {
+            size_t comma = text.find(',', begin);
+            std::string value = text.substr(begin, comma == std::string::npos ? std::string::npos : comma - begin);
+            char* end = nullptr;
+            long number = strtol(value.c_str(), &end, 10);
+            if (value.empty() || *end != '\0' || !setLineParam(probe, axis.name, (int)number)) {
+                return false;
+            }
+            axis.values.push_back((int)number);
+            if (comma == std::string::npos) {
+                break;
+            }
+            begin = comma + 1;
+        }
+        return !axis.values.empty();
+    }
+    
+    // Lines of one image in the coordinates of the image, and the median time to find them
+    static double findLines(LineFinder& finder, HoughMode mode, const cv::Mat& image, int iterations, std::vector<Line>& lines) {
+        std::vector<double> times;
+        for (int i = 0; i < MAX(iterations, 1); i++) {
+            auto start = std::chrono::steady_clock::now();
+            finder.process(image);
+            finder.detect(mode, lines);
+            auto end = std::chrono::steady_clock::now();
+            times.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+        }
+        
+        // Pyramid lines are already in the coordinates of the image
+        if (mode != HoughMode::PyramidLocal) {
+            float scale = image.cols / (float)finder.preprocessedImage().cols;
+            for (auto& line: lines) {
+                line[0] *= scale;
+            }
+        }
+        std::sort(times.begin(), times.end());
+        return percentile(times, 0.5);
+    }
+    
+    static std::string escapeJson(const std::string& text) {
+        std::string escaped;
+        for (char c: text) {
+            if (c == '"' || c == '\\') {
+                escaped += '\\';
+                escaped += c;
+            } else if (c == '\n') {
+                escaped += "\\n";
+            } else {
+                escaped += c;
+            }
+        }
+        return escaped;
+    }
+    
+    // A result is on the front if no other one is at least as fast and as good, and better in one.
+    // Failed configurations are never on the front.
+    static void markPareto(std::vector<SweepResult>& results) {
+        for (auto& result: results) {
+            result.isPareto = !result.isFailed;
+            for (auto& other: results) {
+                if (!result.isPareto) {
+                    break;
+                }
+                if (other.isFailed) {
+                    continue;
+                }
+                bool isNoWorse = other.latencyMs <= result.latencyMs && other.quality >= result.quality;
+                bool isBetter = other.latencyMs < result.latencyMs || other.quality > result.quality;
+                if (isNoWorse && isBetter) {
+                    result.isPareto = false;
+                    break;
+                }
+            }
+        }
+    }
+    
+    bool runSweep(const SweepParams& params, std::vector<SweepResult>& results, std::ostream& json) {
+        std::vector<cv::String> paths;
+        cv::glob(params.imageDir + "*.jpg", paths);
+        std::vector<cv::Mat> images;
+        std::vector<std::string> imagePaths;
+        for (auto& path: paths) {
+            cv::Mat image = cv::imread(path, cv::IMREAD_COLOR);
+            if (image.empty()) {
+                std::cout << "[Sweep] Failed to open image: " << path << std::endl;
+                continue;
+            }
+            images.push_back(image);
+            imagePaths.push_back(path);
+        }
+        if (images.empty()) {
+            return false;
+        }
+        int threads = params.threads > 0 ? params.threads : MAX(1, (int)std::thread::hardware_concurrency());
+        int imageCount = (int)images.size();
+        
+        // Configurations are spread over workers, so each detection runs on a single thread
+        LineParams reference = params.reference;
+        reference.threads = 1;
+        std::vector<std::vector<Line>> truth(imageCount);
+        std::vector<std::string> referenceErrors(imageCount);
+        parallelFor(imageCount, threads, [&](int i) {
+            // An exception would end the worker and the program, so it only drops the image
+            try {
+                LineFinder finder(reference);
+                findLines(finder, params.mode, images[i], 1, truth[i]);
+            } catch (const std::exception& e) {
+                referenceErrors[i] = e.what();
+            }
+        });
+        // Images without reference lines cannot score any configuration
+        int kept = 0;
+        for (int i = 0; i < imageCount; i++) {
+            if (!referenceErrors[i].empty()) {
+                std::cout << "[Sweep] Reference failed on " << imagePaths[i] << ": " << referenceErrors[i] << std::endl;
+                continue;
+            }
+            images[kept] = images[i];
+            truth[kept] = std::move(truth[i]);
+            ++kept;
+        }
+        imageCount = kept;
+        images.resize(imageCount);
+        truth.resize(imageCount);
+        if (images.empty()) {
+            return false;
+        }
+        
+        // Configuration c takes value (c / stride) % count of each axis
+        int configCount = 1;
+        for (auto& axis: params.axes) {
+            configCount *= MAX((int)axis.values.size(), 1);
+        }
+        results.assign(configCount, SweepResult());
+        
+        parallelFor(configCount, threads, [&](int c) {
+            SweepResult& result = results[c];
+            LineParams lineParams = params.base;
+            lineParams.threads = 1;
+            int stride = 1;
+            for (auto& axis: params.axes) {
+                int count = MAX((int)axis.values.size(), 1);
+                int value = axis.values.empty() ? 0 : axis.values[(c / stride) % count];
+                if (!axis.values.empty()) {
+                    setLineParam(lineParams, axis.name, value);
+                }
+                result.values.push_back(value);
+                stride *= count;
+            }
+            
+            // Tolerances are those of the reference, scaled to the input.
+            // Lines are matched one to one, so duplicates count against precision.
+            // A configuration OpenCV rejects fails alone instead of ending the sweep.
+            int found = 0;
+            int expected = 0;
+            int matched = 0;
+            try {
+                LineFinder finder(lineParams);
+                std::vector<Line> lines;
+                for (int i = 0; i < imageCount; i++) {
+                    result.latencyMs += findLines(finder, params.mode, images[i], params.iterations, lines);
+                    
+                    cv::Size size = getProcessingSize(images[i], reference.worksheetLength);
+                    float rhoTolerance = 2.0f * reference.houghResolutionRho * images[i].cols / (float)size.width;
+                    float thetaTolerance = 2.0f * CV_PI / reference.houghResolutionTheta;
+                    found += lines.size();
+                    expected += truth[i].size();
+                    matched += countMatchingLines(lines, truth[i], rhoTolerance, thetaTolerance);
+                }
+            } catch (const std::exception& e) {
+                result.isFailed = true;
+                result.error = e.what();
+                return;
+            }
+            result.latencyMs /= imageCount;
+            result.precision = found > 0 ? matched / (double)found : (expected == 0 ? 1.0 : 0.0);
+            result.recall = expected > 0 ? matched / (double)expected : 1.0;
+            double sum = result.precision + result.recall;
+            result.quality = sum > 0.0 ? 2.0 * result.precision * result.recall / sum : 0.0;
+        });
+        markPareto(results);
+        
+        json << "{\n";
+        json << "  \"images\": " << imageCount << ",\n";
+        json << "  \"iterations\": " << params.iterations << ",\n";
+        json << "  \"minQuality\": " << params.minQuality << ",\n";
+        json << "  \"configurations\": [";
+        for (int c = 0; c < configCount; c++) {
+            const SweepResult& result = results[c];
+            json << (c > 0 ? ",\n" : "\n") << "    {";
+            for (size_t a = 0; a < params.axes.size(); a++) {
+                json << "\"" << params.axes[a].name << "\": " << result.values[a] << ", ";
+            }
+            if (result.isFailed) {
+                json << "\"failed\": true, \"error\": \"" << escapeJson(result.error) << "\"}";
+                continue;
+            }
+            json << "\"latencyMs\": " << result.latencyMs
+                 << ", \"precision\": " << result.precision
+                 << ", \"recall\": " << result.recall
+                 << ", \"quality\": " << result.quality
+                 << ", \"pareto\": " << (result.isPareto ? "true" : "false") << "}";
+        }
+        json << "\n  ]\n}\n";
+        return true;
+    }
+}
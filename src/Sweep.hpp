@@ -0,0 +1,70 @@
+//
+//  Sweep.hpp
+//  local-hough-line-cpp
+//
+//  Created by 박성현 on 17/10/2026.
+//  Copyright © 2019 Sean Park. All rights reserved.
+//
+
+#ifndef Sweep_hpp
+#define Sweep_hpp
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include "LineFinder.hpp"
+
+namespace fh {
+    
+    // Values tried for one field of LineParams
+    struct SweepAxis {
+        std::string name;
+        std::vector<int> values;
+    };
+    
+    class SweepParams {
+    public:
+        std::string imageDir = "images/";
+        HoughMode mode = HoughMode::StandardLocal;
+        // Runs per image and configuration. The median is reported.
+        int iterations = 3;
+        // Configurations evaluated at once. 0 uses every core.
+        int threads = 0;
+        // Lowest F1 score against the reference that is good enough
+        double minQuality = 0.9;
+        
+        // Every combination of the axes' values is applied on top of base
+        std::vector<SweepAxis> axes;
+        LineParams base;
+        // Lines of this configuration are taken as the truth
+        LineParams reference;
+    };
+    
+    struct SweepResult {
+        std::vector<int> values;    // One per axis
+        double latencyMs = 0.0;     // Mean over images of the median preprocessing and detection time
+        double precision = 0.0;
+        double recall = 0.0;
+        double quality = 0.0;       // F1 score of precision and recall
+        bool isPareto = false;      // No other configuration is both faster and better
+        bool isFailed = false;      // OpenCV rejected the configuration, and nothing else is set
+        std::string error;
+    };
+    
+    // Sets the LineParams field of the given name, e.g. "cannyThreshold1".
+    // Smoothing takes the index of the Smoothing value.
+    // Returns false for an unknown name, or a value out of the field's range.
+    bool setLineParam(LineParams& params, const std::string& name, int value);
+    
+    // Parses "name=value,value,...". Returns false if the name or a value is invalid.
+    bool parseSweepAxis(const std::string& text, SweepAxis& axis);
+    
+    // Evaluates every configuration of the grid over the images, several configurations at once,
+    // and marks the Pareto front of latency against agreement with the reference.
+    // Lines are compared in the coordinates of the input, so worksheetLength can be swept too.
+    // Writes every result as JSON. An image on which the reference throws is left out.
+    // Returns false if no image was read, or the reference failed on all of them.
+    bool runSweep(const SweepParams& params, std::vector<SweepResult>& results, std::ostream& json);
+}
+
+#endif /* Sweep_hpp */
@@ -0,0 +1,318 @@
+//
+//  TiledLineFinder.cpp
+//  local-hough-line-cpp
+//
+//  Created by 박성현 on 17/10/2026.
+//  Copyright © 2019 Sean Park. All rights reserved.
+//
+
+#include "TiledLineFinder.hpp"
+#include "Helper.hpp"
+#include "Profiler.hpp"
+#include <algorithm>
+#include <atomic>
+#include <numeric>
+
+namespace fh {
+    
+    // Part of the line inside the pixel centers of rect. Returns false if the line misses it.
+    static bool clipLine(const Line& line, const cv::Rect& rect, cv::Point2f& begin, cv::Point2f& end) {
+        double tcos = cos(line[1]);
+        double tsin = sin(line[1]);
+        // Points are (rho * cos, rho * sin) + s * (-sin, cos)
+        double x0 = line[0] * tcos;
+        double y0 = line[0] * tsin;
+        double dx = -tsin;
+        double dy = tcos;
+        double sMin = -1e9;
+        double sMax = 1e9;
+        
+        auto clipAxis = [&](double p, double d, double low, double high) {
+            if (fabs(d) < 1e-9) {
+                return p >= low && p <= high;
+            }
+            double s0 = (low - p) / d;
+            double s1 = (high - p) / d;
+            sMin = MAX(sMin, MIN(s0, s1));
+            sMax = MIN(sMax, MAX(s0, s1));
+            return sMin <= sMax;
+        };
+        if (!clipAxis(x0, dx, rect.x, rect.x + rect.width - 1) ||
+            !clipAxis(y0, dy, rect.y, rect.y + rect.height - 1)) {
+            return false;
+        }
+        begin = cv::Point2f(x0 + sMin * dx, y0 + sMin * dy);
+        end = cv::Point2f(x0 + sMax * dx, y0 + sMax * dy);
+        return true;
+    }
+    
+    // Moves a line found in a tile whose top left corner is origin into the coordinates of the input
+    static Line translate(const Line& line, cv::Point origin) {
+        float rho = line[0] + origin.x * cos(line[1]) + origin.y * sin(line[1]);
+        return Line(rho, line[1], line[2]);
+    }
+    
+    // Part of the segment inside the pixel centers of rect. Votes are scaled by the part kept.
+    // Returns false if nothing is left.
+    static bool clipSegment(Segment& segment, const cv::Rect& rect) {
+        cv::Point2f begin;
+        cv::Point2f end;
+        if (!clipLine(segment.line, rect, begin, end)) {
+            return false;
+        }
+        
+        // Positions along the line's direction. The end points of a run lie on the line up to a pixel.
+        double tcos = cos(segment.line[1]);
+        double tsin = sin(segment.line[1]);
+        cv::Point2f direction(-tsin, tcos);
+        float s0 = segment.begin.dot(direction);
+        float s1 = segment.end.dot(direction);
+        float low = MAX(MIN(s0, s1), MIN(begin.dot(direction), end.dot(direction)));
+        float high = MIN(MAX(s0, s1), MAX(begin.dot(direction), end.dot(direction)));
+        if (low > high) {
+            return false;
+        }
+        
+        if (s1 != s0) {
+            segment.line[2] *= MIN(1.0f, (high - low) / fabs(s1 - s0));
+        }
+        float x0 = segment.line[0] * tcos;
+        float y0 = segment.line[0] * tsin;
+        segment.begin = cv::Point2f(x0 + low * direction.x, y0 + low * direction.y);
+        segment.end = cv::Point2f(x0 + high * direction.x, y0 + high * direction.y);
+        return true;
+    }
+    
+    static int findRoot(std::vector<int>& parents, int i) {
+        while (parents[i] != i) {
+            parents[i] = parents[parents[i]];
+            i = parents[i];
+        }
+        return i;
+    }
+    
+    // Segments of the same line which meet at a tile border are merged into one.
+    // Segments of one tile are separate runs, so only segments ending on the same border are compared.
+    static void stitch(std::vector<Segment>& segments, int tileSize, float rhoTolerance, float thetaTolerance, float gapTolerance) {
+        int count = (int)segments.size();
+        std::vector<int> parents(count);
+        std::iota(parents.begin(), parents.end(), 0);
+        
+        // (border, segment) for every end point near a tile border. Border k along x lies between
+        // pixels k * tileSize - 1 and k * tileSize, and is split into pieces one tile long.
+        // An end point near two borders is also filed under their corner, for lines crossing it.
+        std::vector<std::pair<int64_t, int>> borders;
+        auto addBorders = [&](const cv::Point2f& point, int i) {
+            float x = point.x + 0.5f;
+            float y = point.y + 0.5f;
+            int kx = cvRound(x / tileSize);
+            int ky = cvRound(y / tileSize);
+            bool isNearX = kx > 0 && fabs(x - kx * tileSize) <= gapTolerance + 1.0f;
+            bool isNearY = ky > 0 && fabs(y - ky * tileSize) <= gapTolerance + 1.0f;
+            int column = MAX(cvFloor(point.x / tileSize), 0);
+            int row = MAX(cvFloor(point.y / tileSize), 0);
+            auto key = [](int64_t kind, int64_t a, int64_t b) {
+                return (kind << 60) | (a << 30) | b;
+            };
+            if (isNearX) {
+                borders.emplace_back(key(0, kx, row), i);
+            }
+            if (isNearY) {
+                borders.emplace_back(key(1, ky, column), i);
+            }
+            if (isNearX && isNearY) {
+                borders.emplace_back(key(2, kx, ky), i);
+            }
+        };
+        for (int i = 0; i < count; i++) {
+            addBorders(segments[i].begin, i);
+            addBorders(segments[i].end, i);
+        }
+        std::sort(borders.begin(), borders.end());
+        
+        auto merge = [&](int i, int j) {
+            const Line& a = segments[i].line;
+            const Line& b = segments[j].line;
+            float dTheta = fabs(a[1] - b[1]);
+            float dRho = fabs(a[0] - b[0]);
+            // (rho, theta) and (-rho, theta - pi) are the same line
+            if (dTheta > CV_PI * 0.5) {
+                dTheta = CV_PI - dTheta;
+                dRho = fabs(a[0] + b[0]);
+            }
+            if (dTheta > thetaTolerance || dRho > rhoTolerance) {
+                return;
+            }
+            
+            // Gap between the two segments along the direction of a
+            cv::Point2f direction(-sin(a[1]), cos(a[1]));
+            float a0 = segments[i].begin.dot(direction);
+            float a1 = segments[i].end.dot(direction);
+            float b0 = segments[j].begin.dot(direction);
+            float b1 = segments[j].end.dot(direction);
+            float gap = MAX(MIN(a0, a1), MIN(b0, b1)) - MIN(MAX(a0, a1), MAX(b0, b1));
+            if (gap <= gapTolerance) {
+                parents[findRoot(parents, j)] = findRoot(parents, i);
+            }
+        };
+        
+        // Every piece of a border has a few end points only
+        for (size_t first = 0; first < borders.size();) {
+            size_t last = first;
+            while (last < borders.size() && borders[last].first == borders[first].first) {
+                ++last;
+            }
+            for (size_t p = first; p < last; p++) {
+                for (size_t q = p + 1; q < last; q++) {
+                    if (borders[p].second != borders[q].second) {
+                        merge(MIN(borders[p].second, borders[q].second), MAX(borders[p].second, borders[q].second));
+                    }
+                }
+            }
+            first = last;
+        }
+        
+        // Lines of a group are averaged by their votes, and the segment spans every member
+        std::vector<Segment> stitched;
+        std::vector<int> groupIndex(count, -1);
+        for (int i = 0; i < count; i++) {
+            int root = findRoot(parents, i);
+            if (groupIndex[root] < 0) {
+                groupIndex[root] = (int)stitched.size();
+                stitched.push_back(segments[root]);
+                stitched.back().line[2] = 0;
+            }
+        }
+        for (int i = 0; i < count; i++) {
+            Segment& group = stitched[groupIndex[findRoot(parents, i)]];
+            const Segment& member = segments[i];
+            const Line& reference = segments[findRoot(parents, i)].line;
+            
+            // Flip members described as (-rho, theta - pi) to the reference's side
+            Line line = member.line;
+            if (fabs(line[1] - reference[1]) > CV_PI * 0.5) {
+                line[0] = -line[0];
+                line[1] += line[1] < reference[1] ? CV_PI : -CV_PI;
+            }
+            
+            float votes = group.line[2] + line[2];
+            if (votes > 0) {
+                group.line[0] = (group.line[0] * group.line[2] + line[0] * line[2]) / votes;
+                group.line[1] = (group.line[1] * group.line[2] + line[1] * line[2]) / votes;
+            }
+            group.line[2] = votes;
+            
+            cv::Point2f direction(-sin(reference[1]), cos(reference[1]));
+            if (member.begin.dot(direction) < group.begin.dot(direction)) {
+                group.begin = member.begin;
+            }
+            if (member.end.dot(direction) < group.begin.dot(direction)) {
+                group.begin = member.end;
+            }
+            if (member.begin.dot(direction) > group.end.dot(direction)) {
+                group.end = member.begin;
+            }
+            if (member.end.dot(direction) > group.end.dot(direction)) {
+                group.end = member.end;
+            }
+        }
+        
+        // Keep theta in [0, pi) after averaging
+        for (auto& segment: stitched) {
+            if (segment.line[1] < 0) {
+                segment.line[0] = -segment.line[0];
+                segment.line[1] += CV_PI;
+            } else if (segment.line[1] >= CV_PI) {
+                segment.line[0] = -segment.line[0];
+                segment.line[1] -= CV_PI;
+            }
+        }
+        segments.swap(stitched);
+    }
+    
+    TiledLineFinder::TiledLineFinder(TileParams params) {
+        this->params = params;
+    }
+    
+    void TiledLineFinder::detect(const cv::Mat& image, std::vector<Segment>& segments) {
+        detect(image.size(), [&image](const cv::Rect& rect, cv::Mat& tile) {
+            tile = image(rect);
+            return true;
+        }, segments);
+    }
+    
+    void TiledLineFinder::detect(cv::Size size, const TileReader& reader, std::vector<Segment>& segments) {
+        FH_PROFILE_SCOPE("Tiled Local Hough");
+        
+        int tileSize = MAX(params.tileSize, 1);
+        int overlap = MAX(params.overlap, 0);
+        int columns = (size.width + tileSize - 1) / tileSize;
+        int rows = (size.height + tileSize - 1) / tileSize;
+        int tileCount = columns * rows;
+        int threads = params.threads > 0 ? params.threads : MAX(1, (int)std::thread::hardware_concurrency());
+        threads = MIN(threads, MAX(tileCount, 1));
+        
+        // Tiles are never downsized, and one thread works on each tile.
+        // A run cut by the border of a tile goes on in the next one, so it is counted, not dropped.
+        // Thresholds are fixed before worksheetLength changes, so they do not grow with the tile.
+        LineParams lineParams = params.lineParams;
+        lineParams.globalThreshold = lineParams.houghThreshold();
+        lineParams.localThreshold = lineParams.houghLocalThreshold();
+        lineParams.worksheetLength = tileSize + 2 * overlap;
+        lineParams.threads = 1;
+        lineParams.countBorderRuns = true;
+        
+        // Segments are kept per tile and joined in tile order, so the result does not depend
+        // on which worker took which tile
+        std::atomic<int> next(0);
+        std::vector<std::vector<Segment>> tileSegments(tileCount);
+        
+        parallelFor(threads, threads, [&](int) {
+            LineFinder finder(lineParams);
+            cv::Mat tile;
+            std::vector<Line> lines;
+            std::vector<Segment> local;
+            
+            for (int idx = next++; idx < tileCount; idx = next++) {
+                // Area this tile owns, and the area it reads
+                cv::Rect own((idx % columns) * tileSize, (idx / columns) * tileSize, tileSize, tileSize);
+                own &= cv::Rect(0, 0, size.width, size.height);
+                cv::Rect read(own.x - overlap, own.y - overlap, own.width + 2 * overlap, own.height + 2 * overlap);
+                read &= cv::Rect(0, 0, size.width, size.height);
+                
+                if (!reader(read, tile) || tile.empty()) {
+                    continue;
+                }
+                finder.process(tile);
+                
+                // Only the runs of each line which pass the locality test
+                if (params.mode == HoughMode::StandardLocal) {
+                    finder.detectLocalSegments(local);
+                } else {
+                    finder.detect(params.mode, lines);
+                    finder.findSegments(lines, local);
+                }
+                
+                // A tile reports only the part of each segment inside the area it owns.
+                // worksheetLength covers the whole tile, so the worksheet is the tile.
+                std::vector<Segment>& found = tileSegments[idx];
+                for (auto& segment: local) {
+                    segment.begin = cv::Point2f(segment.begin.x + read.x, segment.begin.y + read.y);
+                    segment.end = cv::Point2f(segment.end.x + read.x, segment.end.y + read.y);
+                    segment.line = translate(segment.line, read.tl());
+                    if (clipSegment(segment, own)) {
+                        found.push_back(segment);
+                    }
+                }
+            }
+        });
+        
+        segments.clear();
+        for (auto& found: tileSegments) {
+            segments.insert(segments.end(), found.begin(), found.end());
+        }
+        
+        // Areas of neighbouring tiles are a pixel apart
+        stitch(segments, tileSize, 2.0f * lineParams.houghResolutionRho, 2.0f * CV_PI / lineParams.houghResolutionTheta, 2.0f);
+    }
+}
@@ -0,0 +1,58 @@
+//
+//  TiledLineFinder.hpp
+//  local-hough-line-cpp
+//
+//  Created by 박성현 on 17/10/2026.
+//  Copyright © 2019 Sean Park. All rights reserved.
+//
+
+#ifndef TiledLineFinder_hpp
+#define TiledLineFinder_hpp
+
+#include <functional>
+#include <vector>
+#include <opencv2/core.hpp>
+#include "LineFinder.hpp"
+
+namespace fh {
+    
+    class TileParams {
+    public:
+        // Side of the area each tile owns, in pixels of the input
+        int tileSize = 1024;
+        // Pixels each tile reads beyond its own area, so lines crossing a border are seen whole
+        int overlap = 64;
+        // Worker threads. 0 uses every core.
+        int threads = 0;
+        HoughMode mode = HoughMode::StandardLocal;
+        
+        // Tiles are processed at their own resolution, so worksheetLength only sets the thresholds,
+        // in pixels of the input, unless globalThreshold and localThreshold are set.
+        // They do not depend on tileSize or overlap.
+        LineParams lineParams;
+    };
+    
+    // Reads the pixels of the given rectangle of the input into the Mat.
+    // Returns false if they could not be read.
+    typedef std::function<bool(const cv::Rect& rect, cv::Mat& tile)> TileReader;
+    
+    // Finds lines on images too large to preprocess at once.
+    // The input is cut into overlapping tiles, and each worker runs a LineFinder on one tile
+    // at a time, so the working memory is bounded by the tile size times the number of threads.
+    // Segments found in neighbouring tiles are stitched into one.
+    class TiledLineFinder {
+        TileParams params;
+        
+    public:
+        TiledLineFinder(TileParams params = TileParams());
+        
+        // The reader is called from the worker threads. Only the tiles being read are in memory,
+        // so this is the one to use for inputs which do not fit in memory.
+        void detect(cv::Size size, const TileReader& reader, std::vector<Segment>& segments);
+        // Tiles are views of the image, so nothing is copied, but the whole image has to be
+        // in memory already. Only the working memory is bounded.
+        void detect(const cv::Mat& image, std::vector<Segment>& segments);
+    };
+}
+
+#endif /* TiledLineFinder_hpp */
@@ -7,14 +7,680 @@
 //
 
 #include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <chrono>
+#include <vector>
 #include <opencv2/core.hpp>
 #include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
 #include "LineFinder.hpp"
 #include "Visualizer.hpp"
 #include "Helper.hpp"
+#include "Batch.hpp"
+#include "Benchmark.hpp"
+#include "Profiler.hpp"
+#include "TiledLineFinder.hpp"
+#include "LinePipeline.hpp"
+#include "Sweep.hpp"
+
+// Index of the line of lines in the same (rho, theta) bin as line, or -1
+static int findSameBin(const std::vector<fh::Line>& lines, const fh::Line& line, const fh::LineParams& params) {
+    int rho = cvRound(line[0] / params.houghResolutionRho);
+    int theta = cvRound(line[1] * params.houghResolutionTheta / CV_PI);
+    for (size_t i = 0; i < lines.size(); i++) {
+        if (cvRound(lines[i][0] / params.houghResolutionRho) == rho
+            && cvRound(lines[i][1] * params.houghResolutionTheta / CV_PI) == theta) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+// Prints the lines of lines which are not in reference, and returns their count
+static int printMissingLines(const std::vector<fh::Line>& lines, const std::vector<fh::Line>& reference, const fh::LineParams& params, const std::string& label) {
+    int missing = 0;
+    for (auto& line: lines) {
+        if (findSameBin(reference, line, params) < 0) {
+            std::cout << "[Compare]   only " << label << ": " << line[0] << " " << line[1] << " " << line[2] << std::endl;
+            ++missing;
+        }
+    }
+    return missing;
+}
+
+// Exact set difference of two sets of lines: the lines of either side without a line
+// in the same (rho, theta) bin on the other, and the lines of both with different votes
+struct LineDifference {
+    int onlyFirst = 0;
+    int onlySecond = 0;
+    int otherVotes = 0;
+};
+
+static LineDifference findDifference(const std::vector<fh::Line>& first, const std::vector<fh::Line>& second, const fh::LineParams& params) {
+    LineDifference difference;
+    for (auto& line: first) {
+        int i = findSameBin(second, line, params);
+        if (i < 0) {
+            ++difference.onlyFirst;
+        } else if (second[i][2] != line[2]) {
+            ++difference.otherVotes;
+        }
+    }
+    for (auto& line: second) {
+        if (findSameBin(first, line, params) < 0) {
+            ++difference.onlySecond;
+        }
+    }
+    return difference;
+}
+
+static void addDifference(LineDifference& total, const LineDifference& difference) {
+    total.onlyFirst += difference.onlyFirst;
+    total.onlySecond += difference.onlySecond;
+    total.otherVotes += difference.otherVotes;
+}
+
+static void printDifference(const LineDifference& difference, const std::string& first, const std::string& second) {
+    std::cout << "only " << first << " " << difference.onlyFirst
+              << ", only " << second << " " << difference.onlySecond
+              << ", same line with other votes " << difference.otherVotes;
+}
+
+// The locality test of the original didFindLine(), kept as the reference of compare.
+// It follows cv::LineIterator between two points far outside the worksheet, counts a pixel
+// if an edge is in its 3 x 3 neighbourhood, and drops the run reaching the border.
+static void detectBaselineLocalHough(const cv::Mat& edges, const std::vector<fh::Line>& candidates, fh::LineParams params, std::vector<fh::Line>& lines) {
+    // Angles as prepareCosSin() builds them
+    int resolution = params.houghResolutionTheta;
+    int idx45 = resolution / 4;
+    int idx90 = resolution / 2;
+    std::vector<fh::Angle> table;
+    for (int i = 0; i <= idx45; i++) {
+        float theta = ((float)i) / ((float)resolution) * CV_PI;
+        table.push_back(fh::Angle(theta, cos(theta), sin(theta)));
+    }
+    for (int i = idx45 + 1; i <= idx90; i++) {
+        auto a = table[idx90 - i];
+        float theta = ((float)i) / ((float)resolution) * CV_PI;
+        table.push_back(fh::Angle(theta, a[2], a[1]));
+    }
+    for (int i = idx90 + 1; i < resolution; i++) {
+        auto a = table[i - idx90];
+        float theta = ((float)i) / ((float)resolution) * CV_PI;
+        table.push_back(fh::Angle(theta, -a[2], a[1]));
+    }
+    
+    auto isLine = [&edges](const cv::Point& p) {
+        if (p.x <= 0 || p.x >= edges.cols - 1 || p.y <= 0 || p.y >= edges.rows - 1) {
+            return false;
+        }
+        for (int dy = -1; dy <= 1; dy++) {
+            const uchar* row = edges.ptr<uchar>(p.y + dy);
+            if (row[p.x - 1] != 0 || row[p.x] != 0 || row[p.x + 1] != 0) {
+                return true;
+            }
+        }
+        return false;
+    };
+    
+    int threshold = params.houghLocalThreshold();
+    int multiplier = MAX(edges.rows, edges.cols);
+    lines.clear();
+    for (auto& candidate: candidates) {
+        int angleIdx = cvRound(candidate[1] * resolution / CV_PI) % resolution;
+        const fh::Angle& theta = table[angleIdx];
+        double tcos = theta[1];
+        double tsin = theta[2];
+        float rho = candidate[0];
+        cv::Point2f center(rho * tcos, rho * tsin);
+        cv::Point pt0(cvRound(center.x - multiplier * tsin), cvRound(center.y + multiplier * tcos));
+        cv::Point pt1(cvRound(center.x + multiplier * tsin), cvRound(center.y - multiplier * tcos));
+        
+        cv::LineIterator iterator(edges, pt0, pt1);
+        if (iterator.count <= threshold) {
+            continue;
+        }
+        fh::Line line(rho, theta[0], 0);
+        int votes = 0;
+        for (int i = 0; i < iterator.count; i++, ++iterator) {
+            if (**iterator != 0 || isLine(iterator.pos())) {
+                ++votes;
+                continue;
+            }
+            if (votes > threshold) {
+                line[2] += votes;
+            }
+            votes = 0;
+        }
+        if (line[2] > threshold) {
+            lines.push_back(line);
+        }
+    }
+}
+
+// Runs runStandardLocalHough() and the given mode on every image in the directory,
+// and compares the time spent and the lines found. Besides the lines matching within
+// two bins, it reports the exact set difference, i.e. the lines of either side without
+// a line in the same (rho, theta) bin on the other, and the lines whose votes differ.
+// Both are also compared with the original locality walk on the same candidates,
+// and the candidates of the global vote with those of cv::HoughLines.
+static int compareLocalHough(const std::string& imgDir, fh::HoughMode mode, const std::string& name) {
+    std::vector<cv::String> paths;
+    cv::glob(imgDir + "*.jpg", paths);
+    
+    double standardTotal = 0.0;
+    double otherTotal = 0.0;
+    int standardLines = 0;
+    int otherLines = 0;
+    int baselineLines = 0;
+    int matchedLines = 0;
+    LineDifference otherToStandard;
+    LineDifference otherToBaseline;
+    LineDifference standardToBaseline;
+    LineDifference votesToOpenCV;
+    
+    for (auto& path: paths) {
+        cv::Mat image = cv::imread(path, cv::IMREAD_COLOR);
+        if (image.empty()) {
+            std::cout << "Failed to open image: " << path << std::endl;
+            continue;
+        }
+        
+        fh::LineParams params;
+        fh::LineFinder lineFinder(&image, params);
+        
+        std::vector<fh::Line> standard;
+        std::vector<fh::Line> other;
+        auto start = std::chrono::steady_clock::now();
+        lineFinder.detectStandardLocalHough(standard);
+        auto middle = std::chrono::steady_clock::now();
+        lineFinder.detect(mode, other);
+        auto end = std::chrono::steady_clock::now();
+        
+        std::vector<fh::Line> candidates;
+        std::vector<fh::Line> baseline;
+        lineFinder.detectCandidates(candidates);
+        detectBaselineLocalHough(lineFinder.preprocessedImage(), candidates, params, baseline);
+        std::vector<fh::Line> openCVCandidates;
+        cv::HoughLines(lineFinder.preprocessedImage(), openCVCandidates, params.houghResolutionRho, CV_PI / params.houghResolutionTheta, params.houghThreshold());
+        
+        double standardMs = std::chrono::duration<double, std::milli>(middle - start).count();
+        double otherMs = std::chrono::duration<double, std::milli>(end - middle).count();
+        int matched = fh::countMatchingLines(other, standard, 2.0f * params.houghResolutionRho, 2.0f * CV_PI / params.houghResolutionTheta);
+        
+        std::cout << "[Compare] " << path
+                  << ": standard " << standard.size() << " lines " << standardMs << "ms"
+                  << ", " << name << " " << other.size() << " lines " << otherMs << "ms"
+                  << ", baseline " << baseline.size() << " lines"
+                  << ", matched " << matched << std::endl;
+        
+        printMissingLines(standard, other, params, "standard");
+        printMissingLines(other, standard, params, name);
+        addDifference(otherToStandard, findDifference(other, standard, params));
+        addDifference(otherToBaseline, findDifference(other, baseline, params));
+        addDifference(standardToBaseline, findDifference(standard, baseline, params));
+        addDifference(votesToOpenCV, findDifference(candidates, openCVCandidates, params));
+        
+        standardTotal += standardMs;
+        otherTotal += otherMs;
+        standardLines += standard.size();
+        otherLines += other.size();
+        baselineLines += baseline.size();
+        matchedLines += matched;
+    }
+    
+    std::cout << "[Compare] Total: standard " << standardLines << " lines " << standardTotal << "ms"
+              << ", " << name << " " << otherLines << " lines " << otherTotal << "ms"
+              << ", baseline " << baselineLines << " lines"
+              << ", matched " << matchedLines
+              << ", speedup " << (otherTotal > 0.0 ? standardTotal / otherTotal : 0.0) << "x" << std::endl;
+    std::cout << "[Compare] Exact against standard: ";
+    printDifference(otherToStandard, name, "standard");
+    std::cout << std::endl << "[Compare] Exact against baseline: ";
+    printDifference(otherToBaseline, name, "baseline");
+    std::cout << std::endl << "[Compare] Standard against baseline: ";
+    printDifference(standardToBaseline, "standard", "baseline");
+    std::cout << std::endl << "[Compare] Candidates against cv::HoughLines: ";
+    printDifference(votesToOpenCV, "candidates", "cv::HoughLines");
+    std::cout << std::endl;
+    return 0;
+}
+
+// anytime [budget ms]
+// Runs detectAnytimeLocalHough() with the given budget on every image in images/, and reports
+// the time spent and how many lines of detectStandardLocalHough() it confirmed in time.
+static int runAnytime(int argc, const char * argv[]) {
+    double budgetMs = argc > 2 ? atof(argv[2]) : 1.0;
+    std::vector<cv::String> paths;
+    cv::glob("images/*.jpg", paths);
+    
+    int finished = 0;
+    int images = 0;
+    int standardLines = 0;
+    int matchedLines = 0;
+    std::vector<double> times;
+    
+    for (auto& path: paths) {
+        cv::Mat image = cv::imread(path, cv::IMREAD_COLOR);
+        if (image.empty()) {
+            std::cout << "Failed to open image: " << path << std::endl;
+            continue;
+        }
+        
+        fh::LineParams params;
+        fh::LineFinder lineFinder(&image, params);
+        
+        std::vector<fh::Line> standard;
+        std::vector<fh::Line> anytime;
+        lineFinder.detectStandardLocalHough(standard);
+        auto start = std::chrono::steady_clock::now();
+        bool didFinish = lineFinder.detectAnytimeLocalHough(budgetMs, anytime);
+        auto end = std::chrono::steady_clock::now();
+        
+        double ms = std::chrono::duration<double, std::milli>(end - start).count();
+        int matched = fh::countMatchingLines(standard, anytime, 2.0f * params.houghResolutionRho, 2.0f * CV_PI / params.houghResolutionTheta);
+        std::cout << "[Anytime] " << path << ": " << anytime.size() << " lines " << ms << "ms"
+                  << (didFinish ? ", finished" : ", stopped at the deadline")
+                  << ", found " << matched << " of " << standard.size() << std::endl;
+        
+        ++images;
+        finished += didFinish;
+        standardLines += standard.size();
+        matchedLines += matched;
+        times.push_back(ms);
+    }
+    
+    std::sort(times.begin(), times.end());
+    std::cout << "[Anytime] Budget " << budgetMs << "ms: finished " << finished << " of " << images << " images"
+              << ", found " << matchedLines << " of " << standardLines << " lines"
+              << ", p50 " << fh::percentile(times, 0.50) << "ms, max " << (times.empty() ? 0.0 : times.back()) << "ms" << std::endl;
+    return 0;
+}
+
+// pipeline [std|local|naive|fused|gradient|pyramid] [depth]
+// Detects lines on every image in images/ one frame after another, then through LinePipeline,
+// and compares the throughput. Fails if a frame got other lines through the pipeline.
+static int runPipeline(int argc, const char * argv[]) {
+    fh::PipelineParams params;
+    if (argc > 2 && !fh::parseHoughMode(argv[2], params.mode)) {
+        std::cout << "Unknown mode: " << argv[2] << std::endl;
+        return -1;
+    }
+    if (argc > 3) {
+        params.depth = MAX(1, atoi(argv[3]));
+    }
+    
+    std::vector<cv::String> paths;
+    cv::glob("images/*.jpg", paths);
+    std::vector<cv::Mat> frames;
+    for (auto& path: paths) {
+        cv::Mat image = cv::imread(path, cv::IMREAD_COLOR);
+        if (!image.empty()) {
+            frames.push_back(image);
+        }
+    }
+    if (frames.empty()) {
+        std::cout << "No image in images/" << std::endl;
+        return -1;
+    }
+    
+    // Every frame is submitted a few times, so the pipeline runs long enough to fill up
+    const int rounds = 10;
+    int count = rounds * (int)frames.size();
+    
+    // Lines of each frame, kept from the sequential run to check the pipelined one
+    std::vector<std::vector<fh::Line>> expected(frames.size());
+    fh::LineFinder finder(params.lineParams);
+    std::vector<fh::Line> lines;
+    size_t sequentialLines = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; i++) {
+        finder.process(frames[i % frames.size()]);
+        finder.detect(params.mode, lines);
+        sequentialLines += lines.size();
+        if (i < (int)frames.size()) {
+            expected[i] = lines;
+        }
+    }
+    auto middle = std::chrono::steady_clock::now();
+    
+    std::vector<std::vector<fh::Line>> pipelined(count);
+    {
+        fh::LinePipeline pipeline(params);
+        std::vector<std::future<std::vector<fh::Line>>> results;
+        for (int i = 0; i < count; i++) {
+            results.push_back(pipeline.submit(frames[i % frames.size()]));
+        }
+        for (int i = 0; i < count; i++) {
+            pipelined[i] = results[i].get();
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    
+    // Both runs find the very same lines, so nothing short of an exact match is tolerated
+    int mismatchedFrames = 0;
+    size_t pipelinedLines = 0;
+    for (int i = 0; i < count; i++) {
+        auto& reference = expected[i % frames.size()];
+        pipelinedLines += pipelined[i].size();
+        int matched = fh::countMatchingLines(pipelined[i], reference, 0.0f, 0.0f);
+        if (pipelined[i].size() != reference.size() || matched != (int)reference.size()) {
+            ++mismatchedFrames;
+        }
+    }
+    
+    double sequentialSeconds = std::chrono::duration<double>(middle - start).count();
+    double pipelinedSeconds = std::chrono::duration<double>(end - middle).count();
+    std::cout << "[Pipeline] " << count << " frames, sequential " << count / sequentialSeconds << " frames/s"
+              << ", pipelined " << count / pipelinedSeconds << " frames/s with depth " << params.depth
+              << ", lines " << sequentialLines << " and " << pipelinedLines
+              << ", frames with other lines " << mismatchedFrames << std::endl;
+    return mismatchedFrames == 0 ? 0 : 1;
+}
+
+// sweep [std|local|naive|fused|gradient|pyramid] [minQuality=<F1>] [<field>=<value>,<value>,...]...
+// Evaluates every combination of the given LineParams values over images/ against the defaults,
+// writes them to sweep.json, and prints the Pareto front of latency against quality.
+static int runSweep(int argc, const char * argv[]) {
+    fh::SweepParams params;
+    int arg = 2;
+    if (argc > arg && fh::parseHoughMode(argv[arg], params.mode)) {
+        ++arg;
+    }
+    for (; arg < argc; arg++) {
+        std::string text = argv[arg];
+        if (text.compare(0, 11, "minQuality=") == 0) {
+            params.minQuality = atof(text.c_str() + 11);
+            continue;
+        }
+        fh::SweepAxis axis;
+        if (!fh::parseSweepAxis(text, axis)) {
+            std::cout << "Invalid axis: " << text << std::endl;
+            return -1;
+        }
+        params.axes.push_back(axis);
+    }
+    if (params.axes.empty()) {
+        params.axes.push_back({"worksheetLength", {200, 250, 300, 400}});
+        params.axes.push_back({"smoothing", {0, 1, 2, 3}});
+        params.axes.push_back({"houghResolutionTheta", {180, 360}});
+    }
+    
+    std::string jsonPath = "sweep.json";
+    std::ofstream json(jsonPath);
+    if (!json) {
+        std::cout << "Failed to open output: " << jsonPath << std::endl;
+        return -1;
+    }
+    std::vector<fh::SweepResult> results;
+    if (!fh::runSweep(params, results, json)) {
+        std::cout << "No image was measured in " << params.imageDir << std::endl;
+        return -1;
+    }
+    
+    // Failed configurations are never on the front, so only the front is searched
+    std::vector<const fh::SweepResult*> front;
+    int failures = 0;
+    for (auto& result: results) {
+        if (result.isFailed) {
+            ++failures;
+        } else if (result.isPareto) {
+            front.push_back(&result);
+        }
+    }
+    std::sort(front.begin(), front.end(), [](const fh::SweepResult* a, const fh::SweepResult* b) {
+        return a->latencyMs < b->latencyMs;
+    });
+    
+    const fh::SweepResult* pick = nullptr;
+    for (auto result: front) {
+        std::cout << "[Sweep]";
+        for (size_t a = 0; a < params.axes.size(); a++) {
+            std::cout << " " << params.axes[a].name << "=" << result->values[a];
+        }
+        std::cout << ": " << result->latencyMs << "ms, precision " << result->precision
+                  << ", recall " << result->recall << ", F1 " << result->quality << std::endl;
+        if (!pick && result->quality >= params.minQuality) {
+            pick = result;
+        }
+    }
+    if (pick) {
+        std::cout << "[Sweep] Fastest with F1 >= " << params.minQuality << ":";
+        for (size_t a = 0; a < params.axes.size(); a++) {
+            std::cout << " " << params.axes[a].name << "=" << pick->values[a];
+        }
+        std::cout << ", " << pick->latencyMs << "ms" << std::endl;
+    } else {
+        std::cout << "[Sweep] No configuration reaches F1 " << params.minQuality << std::endl;
+    }
+    if (failures > 0) {
+        std::cout << "[Sweep] " << failures << " configurations failed" << std::endl;
+    }
+    std::cout << "[Sweep] " << results.size() << " configurations written to " << jsonPath << std::endl;
+    return 0;
+}
+
+// batch <directory or list file> [output directory] [std|local|naive|fused|gradient|pyramid] [threads]
+// Runs headless over every input, and prints the throughput.
+static int runBatch(int argc, const char * argv[]) {
+    if (argc < 3) {
+        std::cout << "Usage: " << argv[0] << " batch <directory or list file> [output directory] [std|local|naive|fused|gradient|pyramid] [threads]" << std::endl;
+        return -1;
+    }
+    
+    fh::BatchParams params;
+    params.input = argv[2];
+    if (argc > 3) {
+        params.outputDir = argv[3];
+    }
+    if (argc > 4 && !fh::parseHoughMode(argv[4], params.mode)) {
+        std::cout << "Unknown mode: " << argv[4] << std::endl;
+        return -1;
+    }
+    if (argc > 5) {
+        params.threads = atoi(argv[5]);
+    }
+    
+    fh::BatchSummary summary = fh::runBatch(params);
+    std::cout << "[Batch] " << summary.images << " images, " << summary.failures << " failed, "
+              << summary.lines << " lines in " << summary.seconds << "s"
+              << ", " << summary.imagesPerSecond() << " images/s"
+              << ", p50 " << summary.p50Ms << "ms, p99 " << summary.p99Ms << "ms" << std::endl;
+    return summary.failures == 0 ? 0 : 1;
+}
+
+// bench [iterations] [warmup] [output json]
+// Measures every stage and mode over images/, and writes the statistics as JSON.
+static int runBenchmark(int argc, const char * argv[]) {
+    fh::BenchmarkParams params;
+    std::string jsonPath = "benchmark.json";
+    if (argc > 2) {
+        params.iterations = MAX(1, atoi(argv[2]));
+    }
+    if (argc > 3) {
+        params.warmup = MAX(0, atoi(argv[3]));
+    }
+    if (argc > 4) {
+        jsonPath = argv[4];
+    }
+    
+    std::ofstream json(jsonPath);
+    if (!json) {
+        std::cout << "Failed to open output: " << jsonPath << std::endl;
+        return -1;
+    }
+    if (!fh::runBenchmark(params, json)) {
+        std::cout << "No image was measured in " << params.imageDir << std::endl;
+        return -1;
+    }
+    std::cout << "[Benchmark] Written to " << jsonPath << std::endl;
+    return 0;
+}
+
+// tiled <image> [tile size] [std|local|naive|fused|gradient|pyramid]
+// Finds line segments on an image of any size, one tile at a time.
+static int runTiled(int argc, const char * argv[]) {
+    if (argc < 3) {
+        std::cout << "Usage: " << argv[0] << " tiled <image> [tile size] [std|local|naive|fused|gradient|pyramid]" << std::endl;
+        return -1;
+    }
+    
+    fh::TileParams params;
+    if (argc > 3) {
+        params.tileSize = MAX(1, atoi(argv[3]));
+    }
+    if (argc > 4 && !fh::parseHoughMode(argv[4], params.mode)) {
+        std::cout << "Unknown mode: " << argv[4] << std::endl;
+        return -1;
+    }
+    
+    cv::Mat image = cv::imread(argv[2], cv::IMREAD_COLOR);
+    if (image.empty()) {
+        std::cout << "Failed to open image: " << argv[2] << std::endl;
+        return -1;
+    }
+    
+    std::vector<fh::Segment> segments;
+    fh::TiledLineFinder finder(params);
+    auto start = std::chrono::steady_clock::now();
+    finder.detect(image, segments);
+    auto end = std::chrono::steady_clock::now();
+    
+    for (auto& segment: segments) {
+        std::cout << segment.line[0] << " " << segment.line[1] << " " << segment.line[2]
+                  << " " << segment.begin.x << " " << segment.begin.y
+                  << " " << segment.end.x << " " << segment.end.y << std::endl;
+    }
+    std::cout << "[Tiled] " << segments.size() << " segments in "
+              << std::chrono::duration<double, std::milli>(end - start).count() << "ms" << std::endl;
+    return 0;
+}
+
+// bench-preprocess [iterations] [warmup] [output json]
+// Measures the speed and the lines of every preprocessing option over images/.
+static int runPreprocessBenchmark(int argc, const char * argv[]) {
+    fh::BenchmarkParams params;
+    std::string jsonPath = "benchmark_preprocess.json";
+    if (argc > 2) {
+        params.iterations = MAX(1, atoi(argv[2]));
+    }
+    if (argc > 3) {
+        params.warmup = MAX(0, atoi(argv[3]));
+    }
+    if (argc > 4) {
+        jsonPath = argv[4];
+    }
+    
+    std::ofstream json(jsonPath);
+    if (!json) {
+        std::cout << "Failed to open output: " << jsonPath << std::endl;
+        return -1;
+    }
+    if (!fh::runPreprocessBenchmark(params, json)) {
+        std::cout << "No image was measured in " << params.imageDir << std::endl;
+        return -1;
+    }
+    std::cout << "[Benchmark] Written to " << jsonPath << std::endl;
+    return 0;
+}
+
+// bench-runs [iterations] [warmup] [output json]
+// Measures the run-length transform with several numbers of directions over images/.
+static int runRunLengthBenchmark(int argc, const char * argv[]) {
+    fh::BenchmarkParams params;
+    std::string jsonPath = "benchmark_runs.json";
+    if (argc > 2) {
+        params.iterations = MAX(1, atoi(argv[2]));
+    }
+    if (argc > 3) {
+        params.warmup = MAX(0, atoi(argv[3]));
+    }
+    if (argc > 4) {
+        jsonPath = argv[4];
+    }
+    
+    std::ofstream json(jsonPath);
+    if (!json) {
+        std::cout << "Failed to open output: " << jsonPath << std::endl;
+        return -1;
+    }
+    if (!fh::runRunLengthBenchmark(params, json)) {
+        std::cout << "No image was measured in " << params.imageDir << std::endl;
+        return -1;
+    }
+    std::cout << "[Benchmark] Written to " << jsonPath << std::endl;
+    return 0;
+}
+
+// bench-layout [iterations] [warmup] [output json]
+// Measures the local Hough modes over images/ with and without the transposed near-edge mask.
+static int runLayoutBenchmark(int argc, const char * argv[]) {
+    fh::BenchmarkParams params;
+    std::string jsonPath = "benchmark_layout.json";
+    if (argc > 2) {
+        params.iterations = MAX(1, atoi(argv[2]));
+    }
+    if (argc > 3) {
+        params.warmup = MAX(0, atoi(argv[3]));
+    }
+    if (argc > 4) {
+        jsonPath = argv[4];
+    }
+    
+    std::ofstream json(jsonPath);
+    if (!json) {
+        std::cout << "Failed to open output: " << jsonPath << std::endl;
+        return -1;
+    }
+    if (!fh::runLayoutBenchmark(params, json)) {
+        std::cout << "No image was measured in " << params.imageDir << std::endl;
+        return -1;
+    }
+    std::cout << "[Benchmark] Written to " << jsonPath << std::endl;
+    return 0;
+}
 
 int main(int argc, const char * argv[]) {
     
+    // compare [std|naive|fused|gradient], fused by default
+    if (argc > 1 && std::string(argv[1]) == "compare") {
+        std::string name = argc > 2 ? argv[2] : "fused";
+        fh::HoughMode mode;
+        if (!fh::parseHoughMode(name, mode)) {
+            std::cout << "Unknown mode: " << name << std::endl;
+            return -1;
+        }
+        return compareLocalHough("images/", mode, name);
+    }
+    if (argc > 1 && std::string(argv[1]) == "anytime") {
+        return runAnytime(argc, argv);
+    }
+    if (argc > 1 && std::string(argv[1]) == "pipeline") {
+        return runPipeline(argc, argv);
+    }
+    if (argc > 1 && std::string(argv[1]) == "sweep") {
+        return runSweep(argc, argv);
+    }
+    if (argc > 1 && std::string(argv[1]) == "batch") {
+        return runBatch(argc, argv);
+    }
+    if (argc > 1 && std::string(argv[1]) == "bench") {
+        return runBenchmark(argc, argv);
+    }
+    if (argc > 1 && std::string(argv[1]) == "bench-preprocess") {
+        return runPreprocessBenchmark(argc, argv);
+    }
+    if (argc > 1 && std::string(argv[1]) == "bench-runs") {
+        return runRunLengthBenchmark(argc, argv);
+    }
+    if (argc > 1 && std::string(argv[1]) == "bench-layout") {
+        return runLayoutBenchmark(argc, argv);
+    }
+    if (argc > 1 && std::string(argv[1]) == "tiled") {
+        return runTiled(argc, argv);
+    }
+    
     const std::string imgDir("images/");
     const std::string imgName("test1");
     const std::string imgExt(".jpg");
@@ -34,24 +700,43 @@ int main(int argc, const char * argv[]) {
     
     fh::LineFinder* lineFinder = new fh::LineFinder(&image);
     
-    cv::Mat& standardHough = lineFinder->runStandardHough();
+    cv::Mat standardHough = lineFinder->runStandardHough();
     fh::show("Standard Hough(Left-click for results)", lineFinder->preprocessedImage(), standardHough);
     std::string saveStandardHough = imgResultDir + imgName + "_stdHough.png";
     fh::save(saveStandardHough, standardHough, savingSize);
     
-    cv::Mat& standardLocalHough = lineFinder->runStandardLocalHough();
+    cv::Mat standardLocalHough = lineFinder->runStandardLocalHough();
     fh::show("Standard Local Hough(Left-click for results)", lineFinder->preprocessedImage(), standardLocalHough);
     std::string saveStandardLocalHough = imgResultDir + imgName + "_stdLocalHough.png";
     fh::save(saveStandardLocalHough, standardLocalHough, savingSize);
     
-    cv::Mat& naiveLocalHough = lineFinder->runNaiveLocalHough();
+    cv::Mat naiveLocalHough = lineFinder->runNaiveLocalHough();
     fh::show("Naive Local Hough(Left-click for results)", lineFinder->preprocessedImage(), naiveLocalHough);
     std::string saveNaiveLocalHough = imgResultDir + imgName + "_naiveLocalHough.png";
     fh::save(saveNaiveLocalHough, naiveLocalHough, savingSize);
     
+    cv::Mat fusedLocalHough = lineFinder->runFusedLocalHough();
+    fh::show("Fused Local Hough(Left-click for results)", lineFinder->preprocessedImage(), fusedLocalHough);
+    std::string saveFusedLocalHough = imgResultDir + imgName + "_fusedLocalHough.png";
+    fh::save(saveFusedLocalHough, fusedLocalHough, savingSize);
+    
+    cv::Mat gradientLocalHough = lineFinder->runGradientLocalHough();
+    fh::show("Gradient Local Hough(Left-click for results)", lineFinder->preprocessedImage(), gradientLocalHough);
+    std::string saveGradientLocalHough = imgResultDir + imgName + "_gradientLocalHough.png";
+    fh::save(saveGradientLocalHough, gradientLocalHough, savingSize);
+    
+    cv::Mat localSegments = lineFinder->runLocalSegments();
+    fh::show("Local Segments(Left-click for results)", lineFinder->preprocessedImage(), localSegments);
+    std::string saveLocalSegments = imgResultDir + imgName + "_localSegments.png";
+    fh::save(saveLocalSegments, localSegments, savingSize);
+    
     std::string saveOriginal = imgResultDir + imgName + "_orig.png";
     fh::save(saveOriginal, image, savingSize);
     
+#ifdef FH_PROFILE
+    fh::Profiler::instance().print(std::cout);
+#endif
+    
     fh::waitKey();
 
     delete lineFinder;
@@ -0,0 +1,146 @@
+//
+//  AllocationTest.cpp
+//  local-hough-line-cpp
+//
+//  Created by 박성현 on 17/10/2026.
+//  Copyright © 2019 Sean Park. All rights reserved.
+//
+//  The allocation-test target. Streams images/ through one LineFinder, runs every detection mode
+//  on each frame, and fails if a mode allocates once its buffers are warm.
+//  It replaces the global operator new, so it is a program of its own and never part of local-hough-line-cpp.
+//
+//  allocation-test [rounds] [warmup]
+//
+
+#include <atomic>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+#include "LineFinder.hpp"
+
+static std::atomic<long long> allocations(0);
+
+// Counts the allocations of every thread, OpenCV included.
+// new[] and the nothrow versions call this one.
+void* operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* memory = std::malloc(size == 0 ? 1 : size)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+    std::free(memory);
+}
+
+static long long allocationCount() {
+    return allocations.load(std::memory_order_relaxed);
+}
+
+struct CheckedMode {
+    const char* name;
+    bool isChecked;     // false where OpenCV allocates scratch memory on every call
+    std::function<void(fh::LineFinder&)> run;
+    long long allocations;
+};
+
+int main(int argc, const char * argv[]) {
+    const std::string imageDir("images/");
+    // Passes over the frames before counting, so every buffer reaches its size
+    int warmup = 2;
+    // Passes over the frames while counting
+    int rounds = 5;
+    if (argc > 1) {
+        rounds = MAX(1, atoi(argv[1]));
+    }
+    if (argc > 2) {
+        warmup = MAX(1, atoi(argv[2]));
+    }
+    
+    // Frames of one size, like a camera stream
+    std::vector<cv::String> paths;
+    cv::glob(imageDir + "*.jpg", paths);
+    std::vector<cv::Mat> frames;
+    for (auto& path: paths) {
+        cv::Mat image = cv::imread(path, cv::IMREAD_COLOR);
+        if (image.empty()) {
+            continue;
+        }
+        if (!frames.empty() && image.size() != frames[0].size()) {
+            cv::resize(image, image, frames[0].size());
+        }
+        frames.push_back(image);
+    }
+    if (frames.empty()) {
+        std::cout << "[Allocations] No image in " << imageDir << std::endl;
+        return 1;
+    }
+    
+    fh::LineParams params;
+    // Suppression is off by default, so turn it on to check its buffers too
+    params.candidateMergeRho = 2;
+    params.candidateMergeTheta = 2;
+    fh::LineFinder finder(params);
+    std::vector<fh::Line> lines;
+    std::vector<fh::Segment> segments;
+    const cv::Mat* frame = nullptr;
+    
+    // In the order they run on each frame
+    CheckedMode modes[] = {
+        {"process", false, [&](fh::LineFinder& f) { f.process(*frame); }, 0},
+        {"std", true, [&](fh::LineFinder& f) { f.detectStandardHough(lines); }, 0},
+        {"local", true, [&](fh::LineFinder& f) { f.detectStandardLocalHough(lines); }, 0},
+        {"naive", true, [&](fh::LineFinder& f) { f.detectNaiveLocalHough(lines); }, 0},
+        {"fused", true, [&](fh::LineFinder& f) { f.detectFusedLocalHough(lines); }, 0},
+        // The first gradient call of a frame runs cv::Sobel, the second one reuses its gradient
+        {"gradient with Sobel", false, [&](fh::LineFinder& f) { f.detectGradientLocalHough(lines); }, 0},
+        {"gradient", true, [&](fh::LineFinder& f) { f.detectGradientLocalHough(lines); }, 0},
+        // cv::Canny and cv::fitLine run on every strip
+        {"pyramid", false, [&](fh::LineFinder& f) { f.detectPyramidLocalHough(lines); }, 0},
+        {"tracked", true, [&](fh::LineFinder& f) { f.detectTrackedLocalHough(lines); }, 0},
+        {"anytime", true, [&](fh::LineFinder& f) { f.detectAnytimeLocalHough(1000.0, lines); }, 0},
+        {"segments", true, [&](fh::LineFinder& f) { f.detectLocalSegments(segments); }, 0},
+    };
+    
+    auto pass = [&](bool isCounted) {
+        for (auto& image: frames) {
+            frame = &image;
+            for (auto& mode: modes) {
+                long long before = allocationCount();
+                mode.run(finder);
+                if (isCounted) {
+                    mode.allocations += allocationCount() - before;
+                }
+            }
+        }
+    };
+    
+    for (int i = 0; i < warmup; i++) {
+        pass(false);
+    }
+    for (int i = 0; i < rounds; i++) {
+        pass(true);
+    }
+    
+    bool isClean = true;
+    int frameCount = (int)frames.size() * rounds;
+    for (auto& mode: modes) {
+        std::cout << "[Allocations] " << mode.name << ": " << mode.allocations << " in " << frameCount << " frames"
+                  << (mode.isChecked ? "" : " (inside OpenCV, not checked)") << std::endl;
+        if (mode.isChecked && mode.allocations != 0) {
+            isClean = false;
+        }
+    }
+    std::cout << "[Allocations] " << (isClean ? "Steady state makes no allocation" : "FAILED: a checked mode allocated") << std::endl;
+    return isClean ? 0 : 1;
+}